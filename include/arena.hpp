@@ -0,0 +1,11 @@
+#pragma once
+
+namespace eosio {
+
+   /**
+    * Prints the linear memory pages used so far by the current action, as well as the arena usage when built with
+    * WRAPLOCK_ARENA_ALLOCATOR. Used by WRAPLOCK_MEMORY_STATS builds to compare allocators.
+    */
+   void print_memory_stats();
+
+}
@@ -42,19 +42,39 @@ CONTRACT bridge : public contract {
 
 		static checksum256 compute_block_id(checksum256 hash, uint32_t block_num) { 
 
-		  uint8_t fullraw[32] = {0};
+		  uint8_t fullraw[32];
 
 		  uint32_t r_block_num = reverse_bytes(block_num);
 
 		  std::array<uint8_t, 32> ab =  hash.extract_as_byte_array();
 
 		  memcpy(&fullraw[0], (uint8_t *)&r_block_num, 4);
+		  memcpy(&fullraw[4], &ab[4], 28);
 
-		  for (int i = 4; i <32; i++){
-		    memcpy(&fullraw[i], (uint8_t *)&ab[i], 1);
+		  return checksum256(fullraw);
+
+		}
+
+		//largest serialized size hashed from a stack buffer, larger values (e.g. headers with a new producer schedule) use the heap
+		static constexpr size_t HASH_BUFFER_SIZE = 512;
+
+		//sha256 of the serialized value, serialized into a stack buffer of its exact size when it fits.
+		//CDT only exposes one-shot sha256, so variable-length values can't be hashed incrementally instead
+		template<typename T>
+		static checksum256 hash_packed(const T& value) {
+
+		  size_t size = pack_size(value);
+
+		  if (size > HASH_BUFFER_SIZE) {
+		    std::vector<char> serialized = pack(value);
+		    return sha256(serialized.data(), serialized.size());
 		  }
 
-		  return checksum256(fullraw);
+		  char buffer[HASH_BUFFER_SIZE];
+		  datastream<char*> ds(buffer, size);
+		  ds << value;
+
+		  return sha256(buffer, size);
 
 		}
 
@@ -113,10 +133,7 @@ CONTRACT bridge : public contract {
 
 			checksum256 digest() const {
 			  
-			  std::vector<char> serializedFull = pack(*this);
-			  checksum256 hFull = sha256(serializedFull.data(), serializedFull.size());
-
-			  return hFull;
+			  return hash_packed(*this);
 
 			}
 
@@ -172,6 +189,8 @@ CONTRACT bridge : public contract {
 			unsigned_int            							code_sequence = 0;
 			unsigned_int            							abi_sequence  = 0;
 
+			checksum256 digest() const { return hash_packed(*this); }
+
 			EOSLIB_SERIALIZE( actreceipt, (receiver)(act_digest)(global_sequence)(recv_sequence)(auth_sequence)(code_sequence)(abi_sequence) )
 
 		};
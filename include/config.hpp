@@ -0,0 +1,46 @@
+#pragma once
+
+#include <eosio/name.hpp>
+
+#include <array>
+#include <string_view>
+
+// chain configuration built into the wraplock contract, selected by setting the WRAPLOCK_CHAIN_ID,
+// WRAPLOCK_BRIDGE_CONTRACT and WRAPLOCK_PAIRED_CHAIN_ID build options (which define WRAPLOCK_STATIC_CONFIG).
+// Without them the configuration is read from the `global` singleton written by the `init` action
+#ifdef WRAPLOCK_STATIC_CONFIG
+
+namespace eosio { namespace config {
+
+   constexpr bool is_hex_digit(const char c) {
+      return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+   }
+
+   constexpr uint8_t hex_digit_value(const char c) {
+      return c <= '9' ? c - '0' : (c <= 'F' ? c - 'A' + 10 : c - 'a' + 10);
+   }
+
+   constexpr bool is_chain_id(const std::string_view hex) {
+      if (hex.size() != 64) return false;
+      for (const char c : hex) if (!is_hex_digit(c)) return false;
+      return true;
+   }
+
+   constexpr std::array<uint8_t, 32> chain_id_bytes(const std::string_view hex) {
+      std::array<uint8_t, 32> bytes{};
+      for (size_t i = 0; i < bytes.size(); i++) {
+         bytes[i] = (hex_digit_value(hex[2 * i]) << 4) | hex_digit_value(hex[2 * i + 1]);
+      }
+      return bytes;
+   }
+
+   static_assert(is_chain_id(WRAPLOCK_CHAIN_ID), "WRAPLOCK_CHAIN_ID must be 64 hex digits");
+   static_assert(is_chain_id(WRAPLOCK_PAIRED_CHAIN_ID), "WRAPLOCK_PAIRED_CHAIN_ID must be 64 hex digits");
+
+   constexpr std::array<uint8_t, 32> chain_id = chain_id_bytes(WRAPLOCK_CHAIN_ID);
+   constexpr std::array<uint8_t, 32> paired_chain_id = chain_id_bytes(WRAPLOCK_PAIRED_CHAIN_ID);
+   constexpr name bridge_contract = name(WRAPLOCK_BRIDGE_CONTRACT);
+
+} }
+
+#endif
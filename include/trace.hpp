@@ -0,0 +1,23 @@
+#pragma once
+
+#include <eosio/print.hpp>
+
+// compile-time tracing for the wraplock contract, selected with the WRAPLOCK_TRACE_LEVEL build option
+//   0 - off, trace points compile to nothing (default, except for Debug builds)
+//   1 - one line per stage of the deposit, withdraw, cancel and proof verification paths
+//   2 - stage lines plus the values they operate on
+#ifndef WRAPLOCK_TRACE_LEVEL
+#define WRAPLOCK_TRACE_LEVEL 0
+#endif
+
+#if WRAPLOCK_TRACE_LEVEL >= 1
+#define WRAPLOCK_TRACE(stage, ...) eosio::print("[", stage, "] ", __VA_ARGS__, "\n")
+#else
+#define WRAPLOCK_TRACE(stage, ...) ((void)0)
+#endif
+
+#if WRAPLOCK_TRACE_LEVEL >= 2
+#define WRAPLOCK_TRACE_DETAIL(stage, ...) eosio::print("[", stage, "] ", __VA_ARGS__, "\n")
+#else
+#define WRAPLOCK_TRACE_DETAIL(stage, ...) ((void)0)
+#endif
@@ -4,10 +4,15 @@
 #include <eosio/eosio.hpp>
 #include <eosio/singleton.hpp>
 
+#include <algorithm>
+#include <optional>
 #include <string>
 
+#include <arena.hpp>
 #include <bridge.hpp>
+#include <config.hpp>
 #include <eosio.token.hpp>
+#include <trace.hpp>
 
 namespace eosiosystem {
    class system_contract;
@@ -18,9 +23,24 @@ namespace eosio {
    using std::string;
 
    class [[eosio::contract("wraplock")]] wraplock : public contract {
+      public:
+         using contract::contract;
+
+         // structure used for the `emitxfer` action used in proof on wrapped token chain
+         // `sequence` numbers the receipts emitted for each paired chain consecutively, so the paired chain can use a bitmap
+         // or sliding window for replay protection. It is absent from receipts emitted before it was introduced
+         struct [[eosio::table]] xfer {
+           name                         owner;
+           extended_asset               quantity;
+           name                         beneficiary;
+           binary_extension<uint64_t>   sequence;
+         };
+
       private:
 
-         // for bridge communication
+         // for bridge communication, removed by `clearproof` once read (unused when built with WRAPLOCK_INLINE_PROOFS)
+         // the bridge reads these rows from this contract at scope `contract` (see bridge::get_heavy_proof), so they are
+         // shared by all provers; WRAPLOCK_INLINE_PROOFS avoids the shared row altogether
          TABLE lpstruct {
 
             uint64_t id;
@@ -31,7 +51,7 @@ namespace eosio {
 
             EOSLIB_SERIALIZE( lpstruct, (id)(lp) )
 
-         } _light_proof_obj;
+         };
 
          TABLE hpstruct {
 
@@ -43,7 +63,7 @@ namespace eosio {
 
             EOSLIB_SERIALIZE( hpstruct, (id)(hp) )
 
-         } _heavy_proof_obj;
+         };
 
          using lptable = eosio::singleton<"lightproof"_n, lpstruct>;
          using hptable = eosio::singleton<"heavyproof"_n, hpstruct>;
@@ -52,6 +72,48 @@ namespace eosio {
          hptable _heavy_proof;
 
 
+         // structure used for the deposits collected in a batch, an `xfer` without its trailing `sequence` (a binary_extension
+         // is only read correctly as the last field of a row, not from inside a vector)
+         struct batch_xfer {
+            name                          owner;
+            extended_asset                quantity;
+            name                          beneficiary;
+         };
+
+         // structure used for collecting deposits into a single `emitxfers` receipt - see `openbatch` action for documentation
+         // the xfers are allocated when the batch is opened, so deposits fill them without changing the row's RAM usage
+         struct [[eosio::table]] deposit_batch {
+            name                          owner;
+            uint32_t                      filled;
+            std::vector<batch_xfer>       xfers;
+
+            uint64_t primary_key()const { return owner.value; }
+         };
+
+         static constexpr uint32_t MAX_BATCH_XFERS = 100;
+
+         // structure used for the payouts of verified withdrawals while the payout queue is enabled - see `crank` action
+         // `owner` is the account that retired the tokens on paired chain `chain`, which `refundpayout` returns them to
+         struct [[eosio::table]] payout {
+            uint64_t          id;
+            name              beneficiary;
+            extended_asset    quantity;
+            name              owner;
+            name              chain;
+
+            uint64_t primary_key()const { return id; }
+         };
+
+         // structure used for the next `xfer` sequence number, scoped by paired chain
+         struct [[eosio::table]] xfer_sequence {
+            uint64_t          next;
+         };
+
+         // structure used for the payout queue switch - see `setqueue` action for documentation
+         struct [[eosio::table]] payout_queue {
+            bool              enabled;
+         };
+
          // structure used for globals - see `init` action for documentation
          struct [[eosio::table]] global {
             checksum256   chain_id;
@@ -60,6 +122,84 @@ namespace eosio {
             bool          enabled;
          } globalrow;
 
+#ifdef WRAPLOCK_STATIC_CONFIG
+         // structure used for the enabled flag when the chain configuration is built in - see `init` action for documentation
+         struct [[eosio::table]] status {
+            bool          enabled;
+         };
+#endif
+
+
+         // structure used for the paired chains served next to the default chain set by `init` - see `addchain` action
+         // the chain name is the scope of its contract mappings, token registry and replay tables
+         struct [[eosio::table]] paired_chain {
+            name          chain;
+            checksum256   paired_chain_id;
+            name          bridge_contract;
+
+            uint64_t primary_key()const { return chain.value; }
+            checksum256 by_chain_id()const { return paired_chain_id; }
+         };
+
+         // structure used for one transfer of an action result: the `sequence` of the proven action receipt (its
+         // `global_sequence`, the replay protection key) for withdraw and cancel, or of the emitted xfer receipt for
+         // deposits (0 while collected in a deposit batch), the amount transferred and the index of its token in `reserves`
+         struct transfer_result {
+            uint64_t                         sequence;
+            int64_t                          amount;
+            uint8_t                          token;
+         };
+
+         // structure returned by withdraw, cancel and deposit actions. `version` identifies the layout, new fields are only
+         // appended along with a new version. `count` transfers were paid out, returned or emitted, adding up to `totals`
+         // of the tokens whose reserve left is in `reserves` (in the same order, that of their first transfer). Batches
+         // whose result would not fit in MAX_RETURN_VALUE_SIZE leave `transfers` empty, then also `reserves`, then also
+         // `totals`: an empty list with a non-zero `count` was dropped, not missing
+         struct action_result {
+            uint8_t                          version;
+            uint32_t                         count;
+            std::vector<transfer_result>     transfers;
+            std::vector<int64_t>             totals;
+            std::vector<extended_asset>      reserves;
+         };
+
+         static constexpr uint8_t ACTION_RESULT_VERSION = 2;
+
+         // largest action return value accepted by default (the `max_action_return_value_size` chain parameter), which
+         // bounds the results of the query actions below
+         static constexpr size_t MAX_RETURN_VALUE_SIZE = 256;
+
+         // structure used for the receipts checked by the `isprocessed` action, with the timestamp of the paired chain
+         // block holding them
+         struct receipt_query {
+            bridge::actreceipt               receipt;
+            block_timestamp                  block_time;
+         };
+
+         // structure returned by the `isprocessed` action, `rejected` holding one bit per receipt (bit i % 8 of byte i / 8)
+         struct processed_info {
+            block_timestamp                  watermark;
+            std::vector<uint8_t>             rejected;
+         };
+
+         // receipts per `isprocessed` call, 4 bytes of watermark plus a 2 byte length and 248 bytes of bits
+         static constexpr uint32_t MAX_PROCESSED_QUERY = 248 * 8;
+
+         // tokens per `getreserves` call, 8 bytes each plus a 1 byte length
+         static constexpr uint32_t MAX_RESERVES_QUERY = 31;
+
+         // structure returned by the `getconfig` action, `chains` being one page of the paired chains added by `addchain`
+         // and `next_chain` the first chain of the next page (empty on the last page)
+         struct config_info {
+            wraplock::global                 global;
+            std::vector<paired_chain>        chains;
+            name                             next_chain;
+            bool                             payout_queue;
+         };
+
+         // paired chains per `getconfig` call, 48 bytes each next to the 83 bytes of the other fields
+         static constexpr uint32_t MAX_CONFIG_CHAINS = 3;
+
          // structure used for reserve account balances, scoped by token contract
          struct [[eosio::table]] account {
             asset    balance;
@@ -76,7 +216,22 @@ namespace eosio {
             uint64_t by_paired_wraptoken_contract()const { return paired_wraptoken_contract.value; }
          };
 
+         // structure used for the token registry, the `contractmap` rows packed into one row and searched in memory
+         // `by_native` is sorted by native token contract and `by_paired` by paired wraptoken contract - see `migratemap`
+         // `tokens` holds the tokens numbered by `addtoken`, the token id being the position in the vector
+         struct [[eosio::table]] token_registry {
+            std::vector<contract_mapping>                    by_native;
+            std::vector<contract_mapping>                    by_paired;
+            binary_extension<std::vector<extended_symbol>>   tokens;
+         };
+
+         // version tag of the compact `emitpacked` encoding of an xfer:
+         //   version (1 byte) | owner (8 bytes) | beneficiary (8 bytes) | token id | amount | sequence
+         // where the token id, amount and sequence are unsigned LEB128 varints
+         static constexpr uint8_t XFER_PACKED_VERSION = 2;
+
          // structure used for retaining action receipt digests of accepted proven actions, to prevent replay attacks
+         // (superseded by the `replay` table, still checked until dropped by `prune`)
          struct [[eosio::table]] processed {
 
            uint64_t                        id;
@@ -87,24 +242,121 @@ namespace eosio {
 
          };
 
-         void sub_reserve(const extended_asset& value );
-         void add_reserve(const extended_asset& value );
-         void add_or_assert(const bridge::actionproof& actionproof, const name& payer);
-         void _withdraw(const name& prover, const bridge::actionproof actionproof);
-         void _cancel(const name& prover, const bridge::actionproof actionproof);
+         // structure used for replay protection, holding one bit per paired chain action receipt `global_sequence`
+         // the page number is the global sequence divided by REPLAY_PAGE_BITS, `latest` is the newest proven block timestamp
+         struct [[eosio::table]] replaypage {
 
-      public:
-         using contract::contract;
+           uint64_t                        page;
+           block_timestamp                 latest;
+           std::vector<uint64_t>           bits;
+
+           uint64_t primary_key()const { return page; }
 
-         // structure used for the `emitxfer` action used in proof on wrapped token chain
-         struct [[eosio::table]] xfer {
-           name             owner;
-           extended_asset   quantity;
-           name             beneficiary;
          };
 
+         // global sequences covered by one replay page. The paired chain sequence counts every action, so retired
+         // transfers are sparse within it and a page is kept no larger than the 32-byte digest row it replaces
+         static constexpr uint64_t REPLAY_PAGE_BITS = 256;
+         static constexpr uint64_t REPLAY_PAGE_WORDS = REPLAY_PAGE_BITS / 64;
+
+         // structure used for the replay watermark - see `prune` action for documentation
+         // `retention` is the age in seconds of a paired chain block after which `prune` may move the watermark past it,
+         // set by the contract account through `prune`
+         struct [[eosio::table]] replay_state {
+            block_timestamp               watermark;
+            time_point                    legacy_cutoff;
+            binary_extension<uint32_t>    retention;
+         };
+
+         // chain configuration and enabled flag, from the `global` singleton or built in (WRAPLOCK_STATIC_CONFIG)
+         void check_initialized();
+         const wraplock::global& get_global();
+         void set_enabled(const bool enabled);
+
+         // reserve balance held in the state cache, `itr` is the database iterator of its row (negative if the row does
+         // not exist yet)
+         struct cached_reserve {
+            name       contract;
+            asset      balance;
+            int32_t    itr;
+            bool       modified;
+         };
+
+         // rows read by the current action, each loaded from the database at most once. Modified rows are written back
+         // once by `flush_state` when the action completes, so batch flows do not repeat reads and writes per transfer
+         std::optional<wraplock::global>          _cached_global;
+         bool                                     _global_modified = false;
+         std::vector<contract_mapping>            _cached_mappings;
+         std::optional<token_registry>            _cached_registry;
+         bool                                     _registry_loaded = false;
+         std::vector<cached_reserve>              _cached_reserves;
+
+         const token_registry* get_registry();
+         std::optional<contract_mapping> find_mapping(const name& native_token_contract);
+         std::optional<contract_mapping> find_paired_mapping(const name& paired_wraptoken_contract);
+         cached_reserve& get_reserve(const extended_asset& value);
+         void flush_state();
+
+         // paired chain the current action operates on, selected once per action. The default chain configured by `init`
+         // uses scope `_self`, so deployments serving a single chain keep their existing tables
+         struct chain_route {
+            name          scope;
+            name          bridge_contract;
+            checksum256   paired_chain_id;
+         };
+
+         std::optional<chain_route>               _route;
+
+         const chain_route& select_chain(const name& chain);
+         const chain_route& select_proof_chain(const checksum256& paired_chain_id);
+         const chain_route& route();
+
+         bool is_legacy_processed(const bridge::actreceipt& receipt);
+         bool is_processed(const bridge::actreceipt& receipt);
+         void mark_processed(const uint64_t global_sequence, const block_timestamp& block_time, const name& payer);
+
+         // serialized proofs of the current action, viewed in place in its action data (`prover`, block proof, then one
+         // action proof or a vector of them) so they can be handed to the bridge without being copied or re-serialized
+         struct proof_view {
+            std::vector<char>                        data;
+            name                                     handoff_table;
+            name                                     check_name;
+            size_t                                   blockproof_end;
+            std::vector<std::pair<size_t, size_t>>   actionproofs;
+         };
+
+         template<typename T>
+         proof_view view_proofs(const T& blockproof, const bridge::actionproof& actionproof);
+         template<typename T>
+         proof_view view_proofs(const T& blockproof, const std::vector<bridge::actionproof>& actionproofs);
+
+         void store_proof(const proof_view& view);
+         void check_action(const name& bridge_contract, const proof_view& view, const size_t index);
+         void release_proof();
+
+         void sub_reserve(const extended_asset& value );
+         void add_reserve(const extended_asset& value );
+         void add_or_assert(const bridge::actionproof& actionproof, const block_timestamp& block_time, const name& payer);
+         wraplock::xfer read_xfer(const bridge::actionproof& actionproof);
+         void _withdraw(const name& prover, const block_timestamp& block_time, const bridge::actionproof& actionproof, const wraplock::xfer& redeemed);
+         void send_payouts(const std::vector<wraplock::xfer>& redeemed);
+         void pay_or_queue(const name& prover, const std::vector<wraplock::xfer>& redeemed);
+         void add_result(wraplock::action_result& result, const uint64_t sequence, const wraplock::xfer& xfer);
+         void fit_result(wraplock::action_result& result);
+         void set_deposit_result(const wraplock::xfer& xfer);
+         uint64_t next_sequences(const uint64_t count);
+         std::optional<uint32_t> find_token_id(const extended_symbol& token);
+         std::vector<char> encode_xfer(const wraplock::xfer& xfer, const uint32_t token_id);
+         wraplock::xfer decode_xfer(const bridge::action& act);
+         void send_xfer(wraplock::xfer& xfer);
+         void send_xfers(std::vector<wraplock::xfer>& xfers);
+         wraplock::xfer _cancel(const name& prover, const block_timestamp& block_time, const bridge::actionproof& actionproof, const wraplock::xfer& retired);
+
+      public:
          /**
           * Allows contract account to set which chains and associated bridge contracts are used for interchain transfers.
+          * When built with WRAPLOCK_STATIC_CONFIG the values must match the built-in configuration, and only the
+          * enabled flag is stored.
           *
           * @param chain_id - the id of the chain running this contract
           * @param bridge_contract - the bridge contract on this chain
@@ -113,22 +365,55 @@ namespace eosio {
          [[eosio::action]]
          void init(const checksum256& chain_id, const name& bridge_contract, const checksum256& paired_chain_id);
 
+         /**
+          * Allows contract account to serve an additional paired chain from this contract. Reserves are shared with the
+          * default chain, while contract mappings and replay protection are kept per chain. Deposits are sent to the
+          * chain with a `beneficiary@chain` memo, and are emitted as `emitxferto` receipts tagged with its chain id.
+          *
+          * @param chain - the name of the paired chain, used as scope of its tables
+          * @param paired_chain_id - the id of the chain hosting the wrapped tokens
+          * @param bridge_contract - the bridge contract on this chain proving blocks of the paired chain
+          */
+         [[eosio::action]]
+         void addchain(const name& chain, const checksum256& paired_chain_id, const name& bridge_contract);
+
+         /**
+          * Allows contract account to stop serving a paired chain added by `addchain`. Its contract mappings must be
+          * removed first.
+          *
+          * @param chain - the name of the paired chain
+          */
+         [[eosio::action]]
+         void delchain(const name& chain);
+
          /**
           * Allows contract account to add support for an asset contract for interchain transfers.
           *
           * @param native_token_contract - the token contract being enabled for interchain transfers
           * @param paired_wraptoken_contract - the corresponding wraptoken contract which transfers are sent to/from
+          * @param chain - the paired chain added by `addchain` (the default chain if omitted)
           */
          [[eosio::action]]
-         void addcontract(const name& native_token_contract, const name& paired_wraptoken_contract);
+         void addcontract(const name& native_token_contract, const name& paired_wraptoken_contract, const binary_extension<name>& chain);
 
          /**
           * Allows contract account to disable support for an asset contract for interchain transfers.
           *
           * @param native_token_contract - the token contract being disabled for interchain transfers
+          * @param chain - the paired chain added by `addchain` (the default chain if omitted)
           */
          [[eosio::action]]
-         void delcontract(const name& native_token_contract);
+         void delcontract(const name& native_token_contract, const binary_extension<name>& chain);
+
+         /**
+          * Allows contract account to build the token registry from the `contractmap` table. Once the registry exists,
+          * deposits, withdrawals and cancellations look token contracts up in it with a single row read instead of
+          * walking the `contractmap` indexes, and `addcontract`/`delcontract` maintain both.
+          *
+          * @param chain - the paired chain added by `addchain` (the default chain if omitted)
+          */
+         [[eosio::action]]
+         void migratemap(const binary_extension<name>& chain);
 
          /**
           * Allows `prover` account to redeem native tokens and send them to the beneficiary indentified in the `actionproof`.
@@ -138,7 +423,7 @@ namespace eosio {
           * @param actionproof - the proof structure for the `emitxfer` action associated with the `retire` action on the wrapped tokens chain
           */
          [[eosio::action]]
-         void withdrawa(const name& prover, const bridge::heavyproof blockproof, const bridge::actionproof actionproof);
+         wraplock::action_result withdrawa(const name& prover, const bridge::heavyproof& blockproof, const bridge::actionproof& actionproof);
 
          /**
           * Allows `prover` account to redeem native tokens and send them to the beneficiary indentified in the `actionproof`.
@@ -148,7 +433,29 @@ namespace eosio {
           * @param actionproof - the proof structure for the `emitxfer` action associated with the `retire` action on the wrapped tokens chain
           */
          [[eosio::action]]
-         void withdrawb(const name& prover, const bridge::lightproof blockproof, const bridge::actionproof actionproof);
+         wraplock::action_result withdrawb(const name& prover, const bridge::lightproof& blockproof, const bridge::actionproof& actionproof);
+
+         /**
+          * Allows `prover` account to redeem native tokens for several `emitxfer` actions proven against the same block.
+          * The block proof is handed to the bridge once, and a single transfer is sent per beneficiary and token.
+          *
+          * @param prover - the calling account whose ram is used for storing the action receipt digests to prevent replay attacks
+          * @param blockproof - the heavy proof data structure
+          * @param actionproofs - the proof structures for the `emitxfer` actions associated with `retire` actions on the wrapped tokens chain
+          */
+         [[eosio::action]]
+         wraplock::action_result withdrawbata(const name& prover, const bridge::heavyproof& blockproof, const std::vector<bridge::actionproof>& actionproofs);
+
+         /**
+          * Allows `prover` account to redeem native tokens for several `emitxfer` actions proven against the same block.
+          * The block proof is handed to the bridge once, and a single transfer is sent per beneficiary and token.
+          *
+          * @param prover - the calling account whose ram is used for storing the action receipt digests to prevent replay attacks
+          * @param blockproof - the light proof data structure
+          * @param actionproofs - the proof structures for the `emitxfer` actions associated with `retire` actions on the wrapped tokens chain
+          */
+         [[eosio::action]]
+         wraplock::action_result withdrawbatb(const name& prover, const bridge::lightproof& blockproof, const std::vector<bridge::actionproof>& actionproofs);
       
          /**
           * Allows `prover` account to cancel a token transfer and return them to the beneficiary indentified in the `actionproof`.
@@ -158,7 +465,7 @@ namespace eosio {
           * @param actionproof - the proof structure for the `emitxfer` action associated with the retiring transfer action on the native chain
           */
          [[eosio::action]]
-         void cancela(const name& prover, const bridge::heavyproof blockproof, const bridge::actionproof actionproof);
+         wraplock::action_result cancela(const name& prover, const bridge::heavyproof& blockproof, const bridge::actionproof& actionproof);
 
          /**
           * Allows `prover` account to cancel a token transfer and return them to the beneficiary indentified in the `actionproof`.
@@ -168,7 +475,29 @@ namespace eosio {
           * @param actionproof - the proof structure for the `emitxfer` action associated with the retiring transfer action on the native chain
           */
          [[eosio::action]]
-         void cancelb(const name& prover, const bridge::lightproof blockproof, const bridge::actionproof actionproof);
+         wraplock::action_result cancelb(const name& prover, const bridge::lightproof& blockproof, const bridge::actionproof& actionproof);
+
+         /**
+          * Allows `prover` account to cancel several token transfers proven against the same block, returning them in
+          * a single `emitxfers` receipt.
+          *
+          * @param prover - the calling account whose ram is used for storing the action receipt digests to prevent replay attacks
+          * @param blockproof - the heavy proof data structure
+          * @param actionproofs - the proof structures for the `emitxfer` actions associated with the retiring transfer actions on the native chain
+          */
+         [[eosio::action]]
+         wraplock::action_result cancelbata(const name& prover, const bridge::heavyproof& blockproof, const std::vector<bridge::actionproof>& actionproofs);
+
+         /**
+          * Allows `prover` account to cancel several token transfers proven against the same block, returning them in
+          * a single `emitxfers` receipt.
+          *
+          * @param prover - the calling account whose ram is used for storing the action receipt digests to prevent replay attacks
+          * @param blockproof - the light proof data structure
+          * @param actionproofs - the proof structures for the `emitxfer` actions associated with the retiring transfer actions on the native chain
+          */
+         [[eosio::action]]
+         wraplock::action_result cancelbatb(const name& prover, const bridge::lightproof& blockproof, const std::vector<bridge::actionproof>& actionproofs);
 
          /**
           * The inline action created by this contract when tokens are locked. Proof of this action is used on the wrapped token chain.
@@ -176,6 +505,59 @@ namespace eosio {
          [[eosio::action]]
          void emitxfer(const wraplock::xfer& xfer);
 
+         /**
+          * The inline action created by this contract after the bridge has checked a block proof handed through the
+          * `lightproof`/`heavyproof` singletons, so the proof is removed before the end of the transaction.
+          */
+         [[eosio::action]]
+         void clearproof();
+
+         /**
+          * The inline action created by this contract when several transfers are emitted at once. A single proof of this action
+          * is used on the wrapped token chain in place of one `emitxfer` proof per transfer.
+          */
+         [[eosio::action]]
+         void emitxfers(const std::vector<wraplock::xfer>& xfers);
+
+         /**
+          * The inline action created by this contract in place of `emitxfer` for paired chains added by `addchain`. The
+          * chain id lets the wrapped token contract of each paired chain reject receipts meant for another chain.
+          *
+          * @param paired_chain_id - the id of the chain the receipt is meant for
+          * @param xfer - the transfer
+          */
+         [[eosio::action]]
+         void emitxferto(const checksum256& paired_chain_id, const wraplock::xfer& xfer);
+
+         /**
+          * The inline action created by this contract in place of `emitxfers` for paired chains added by `addchain`.
+          *
+          * @param paired_chain_id - the id of the chain the receipt is meant for
+          * @param xfers - the transfers
+          */
+         [[eosio::action]]
+         void emitxfersto(const checksum256& paired_chain_id, const std::vector<wraplock::xfer>& xfers);
+
+         /**
+          * The inline action created by this contract in place of `emitxfer` for tokens numbered by `addtoken`, carrying the
+          * transfer in the compact encoding described at XFER_PACKED_VERSION (about half the size of an `xfer`).
+          *
+          * @param data - the encoded transfer, starting with its version tag
+          */
+         [[eosio::action]]
+         void emitpacked(const std::vector<char>& data);
+
+         /**
+          * Allows contract account to number a token of a registered token contract, so its transfers with the default
+          * chain are emitted as `emitpacked` receipts and proofs of `emitpacked` receipts from the paired chain are
+          * accepted for it. Ids are assigned consecutively from 0 and must be registered in the same order on the paired
+          * chain. Requires the token registry (see `migratemap`).
+          *
+          * @param token - the token, as symbol and native token contract
+          */
+         [[eosio::action]]
+         void addtoken(const extended_symbol& token);
+
          /**
           * Disable all user actions on the contract.
           */
@@ -187,54 +569,218 @@ namespace eosio {
           */
          [[eosio::action]]
          void enable();
+
+         /**
+          * Allows contract account to reclaim replay protection RAM. Moves the watermark up to `retention` seconds before
+          * the current time, then deletes up to `max_rows` replay pages (in global sequence order) whose proofs are all
+          * older than the watermark, followed by legacy digest rows once the watermark has passed the time they were
+          * superseded.
+          *
+          * Proofs of paired chain blocks older than the watermark are rejected. Once pruning is in use, a transfer not
+          * withdrawn or cancelled within `retention` of its block can never be recovered: its tokens stay retired on
+          * the paired chain and locked in this contract. The watermark never moves back, so raising `retention` later
+          * does not restore transfers already behind it.
+          *
+          * @param max_rows - the maximum number of rows to delete in this call
+          * @param chain - the paired chain added by `addchain` (the default chain if omitted)
+          * @param retention - the retention window in seconds, stored for the chain. Required by the first call, later
+          * calls use the stored window if omitted
+          */
+         [[eosio::action]]
+         void prune(const uint32_t max_rows, const binary_extension<name>& chain, const binary_extension<uint32_t>& retention);
          
+         /**
+          * Returns, for each action receipt, whether a proof of it would be rejected as a replay: set if it has already
+          * been accepted as proof, or if its block is older than the replay watermark (see `prune`), so its replay record
+          * may be gone. The watermark is returned as well, to tell the two apart. Replay protection is keyed by the
+          * receipt `global_sequence` (see `replay` table), so receipts are taken rather than digests. Takes at most
+          * MAX_PROCESSED_QUERY receipts, keeping the result under MAX_RETURN_VALUE_SIZE.
+          *
+          * @param receipts - the action receipts of the proofs to check, with the timestamps of their blocks
+          * @param chain - the paired chain added by `addchain` the receipts belong to (the default chain if omitted)
+          */
+         [[eosio::action, eosio::read_only]]
+         wraplock::processed_info isprocessed(const std::vector<wraplock::receipt_query>& receipts, const binary_extension<name>& chain);
+
+         /**
+          * Returns the locked balance amount of each token, in the order given, zero for tokens without reserve. Takes at
+          * most MAX_RESERVES_QUERY tokens, keeping the result under MAX_RETURN_VALUE_SIZE.
+          *
+          * @param tokens - the tokens, as symbol and native token contract
+          */
+         [[eosio::action, eosio::read_only]]
+         std::vector<int64_t> getreserves(const std::vector<extended_symbol>& tokens);
+
+         /**
+          * Returns the chain configuration, whether withdrawal payouts are queued and a page of at most MAX_CONFIG_CHAINS
+          * of the paired chains added by `addchain`, keeping the result under MAX_RETURN_VALUE_SIZE. Further pages are
+          * read by passing the returned `next_chain`.
+          *
+          * @param first_chain - the first paired chain of the page (empty for the first page)
+          */
+         [[eosio::action, eosio::read_only]]
+         wraplock::config_info getconfig(const name& first_chain);
+
          /**
           * Allows contract account to clear existing state except which chains and associated contracts are used.
           */
          //[[eosio::action]]
          //void clear();
 
+         /**
+          * Allows contract account to switch withdrawals between paying out in the withdraw transaction (default) and
+          * queueing their payouts for `crank`. Queued payouts are unaffected by switching back.
+          *
+          * @param enabled - true to queue the payouts of verified withdrawals
+          */
+         [[eosio::action]]
+         void setqueue(const bool enabled);
+
+         /**
+          * Allows any account to pay out up to `max_payouts` queued withdrawals in id order, starting from `first_id`.
+          * A single transfer is sent per beneficiary and token, and the RAM of the queued rows is returned to their
+          * provers. A payout whose transfer fails (e.g. rejected by the beneficiary) fails the whole call, so it can be
+          * stepped over by starting past its id, and returned to the paired chain by `refundpayout`.
+          *
+          * @param max_payouts - the maximum number of queued payouts to process in this call
+          * @param first_id - the id of the first payout to process (the oldest queued payout if omitted)
+          */
+         [[eosio::action]]
+         void crank(const uint32_t max_payouts, const binary_extension<uint64_t>& first_id);
+
+         /**
+          * Allows contract account to return a queued payout that can't be paid to the paired chain it was retired on.
+          * The tokens are locked in the reserve again and an xfer receipt is emitted to the account that retired them,
+          * as for a cancelled transfer.
+          *
+          * @param id - the id of the queued payout
+          */
+         [[eosio::action]]
+         void refundpayout(const uint64_t id);
+
+         /**
+          * Allows `owner` account to collect its next deposits into a single `emitxfers` receipt, so the wrapped token chain
+          * needs one proof for all of them. Each deposit keeps its own beneficiary (memo). The batch is emitted by `closebatch`.
+          *
+          * @param owner - the account making the deposits, whose ram is used for the batch
+          * @param count - the maximum number of deposits in the batch
+          */
+         [[eosio::action]]
+         void openbatch(const name& owner, const uint32_t count);
+
+         /**
+          * Allows `owner` account to emit the deposits collected since `openbatch` as a single `emitxfers` receipt.
+          *
+          * @param owner - the account which opened the batch
+          */
+         [[eosio::action]]
+         void closebatch(const name& owner);
+
          /**
           * On transfer notification, calls the deposit function which locks the `quantity` of tokens sent in the reserve and calls
           * the `emitxfer` action inline so that can be used as the basis for a proof of locking for the issue/cancel actions
-          * on the wrapped token chain.
+          * on the wrapped token chain. While `from` has an open deposit batch, the transfer is added to it instead.
+          * The transfer and the reserve left are returned as an `action_result` in the notification's return value.
           *
           * @param from - the owner of the tokens to be sent to the wrapped token chain
           * @param to - this contract account
           * @param quantity - the asset to be sent to the wrapped token chain
-          * @param memo - the beneficiary account on the wrapped token chain
+          * @param memo - the beneficiary account on the wrapped token chain, as `beneficiary@chain` for a chain added by `addchain`
           */
          [[eosio::on_notify("*::transfer")]] void deposit(name from, name to, asset quantity, string memo);
 
          using transfer_action = action_wrapper<"transfer"_n, &token::transfer>;
+#ifdef WRAPLOCK_INLINE_PROOFS
+         using heavyproof_action = action_wrapper<"checkproofe"_n, &bridge::checkproofe>;
+         using lightproof_action = action_wrapper<"checkprooff"_n, &bridge::checkprooff>;
+#else
          using heavyproof_action = action_wrapper<"checkproofb"_n, &bridge::checkproofb>;
          using lightproof_action = action_wrapper<"checkproofc"_n, &bridge::checkproofc>;
+#endif
+         using clearproof_action = action_wrapper<"clearproof"_n, &wraplock::clearproof>;
          using emitxfer_action = action_wrapper<"emitxfer"_n, &wraplock::emitxfer>;
+         using emitxfers_action = action_wrapper<"emitxfers"_n, &wraplock::emitxfers>;
+         using emitxferto_action = action_wrapper<"emitxferto"_n, &wraplock::emitxferto>;
+         using emitxfersto_action = action_wrapper<"emitxfersto"_n, &wraplock::emitxfersto>;
+         using emitpacked_action = action_wrapper<"emitpacked"_n, &wraplock::emitpacked>;
 
          typedef eosio::multi_index< "reserves"_n, account > reserves;
          typedef eosio::multi_index< "contractmap"_n, contract_mapping,
             indexed_by<"wraptoken"_n, const_mem_fun<contract_mapping, uint64_t, &contract_mapping::by_paired_wraptoken_contract>> > contractmapping;
+
+         typedef eosio::multi_index< "chains"_n, paired_chain,
+            indexed_by<"chainid"_n, const_mem_fun<paired_chain, checksum256, &paired_chain::by_chain_id>> > pairedchainstable;
       
+         using registrytable = eosio::singleton<"registry"_n, token_registry>;
+
          typedef eosio::multi_index< "processed"_n, processed,
             indexed_by<"digest"_n, const_mem_fun<processed, checksum256, &processed::by_digest>>> processedtable;
 
+
+         typedef eosio::multi_index< "batches"_n, deposit_batch > batchestable;
+
+         typedef eosio::multi_index< "payouts"_n, payout > payoutstable;
+
+         using payoutqueuetable = eosio::singleton<"payoutqueue"_n, payout_queue>;
+
+         using xfersequencetable = eosio::singleton<"xfersequence"_n, xfer_sequence>;
+
+         typedef eosio::multi_index< "replay"_n, replaypage > replaytable;
+
+         using replaystatetable = eosio::singleton<"replaystate"_n, replay_state>;
+
+#ifdef WRAPLOCK_STATIC_CONFIG
+         using statustable = eosio::singleton<"status"_n, status>;
+
+         statustable _status;
+#else
          using globaltable = eosio::singleton<"global"_n, global>;
 
          globaltable global_config;
+#endif
 
          processedtable _processedtable;
-         contractmapping _contractmappingtable;
+         batchestable _batchestable;
+         pairedchainstable _pairedchainstable;
+         payoutstable _payoutstable;
+         payoutqueuetable _payoutqueue;
+
+         // tables scoped by the paired chain of the action, opened by `select_chain`
+         std::optional<replaytable> _replaytable;
+         std::optional<replaystatetable> _replaystate;
+         std::optional<contractmapping> _contractmappingtable;
+         std::optional<registrytable> _registry;
+
+         replaytable& replay_table();
+         replaystatetable& replay_state_table();
+         contractmapping& mapping_table();
+         registrytable& registry_table();
 
          wraplock( name receiver, name code, datastream<const char*> ds ) :
          contract(receiver, code, ds),
+#ifdef WRAPLOCK_STATIC_CONFIG
+         _status(_self, _self.value),
+#else
          global_config(_self, _self.value),
+#endif
          _processedtable(_self, _self.value),
-         _contractmappingtable(_self, _self.value),
+         _batchestable(_self, _self.value),
+         _pairedchainstable(_self, _self.value),
+         _payoutstable(_self, _self.value),
+         _payoutqueue(_self, _self.value),
          _light_proof(receiver, receiver.value),
          _heavy_proof(receiver, receiver.value)
          {
 
          }
+
+         ~wraplock()
+         {
+            flush_state();
+#ifdef WRAPLOCK_MEMORY_STATS
+            print_memory_stats();
+#endif
+         }
         
    };
 
@@ -0,0 +1,359 @@
+#include <wraplock.hpp>
+
+#include <mock_chain.hpp>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+
+// replays synthetic deposits, withdrawals and cancels through the wraplock contract compiled for the host, against the
+// in-memory intrinsics of mock_chain.cpp, and reports throughput, database operations and heap allocations per phase.
+// The bridge is a stub accepting every proof check, except every `--reject-every`th one which fails its transaction
+//
+//   wraplock_native [--deposits N] [--withdrawals N] [--batch N] [--cancels N] [--reject-every N] [--trace]
+
+using namespace eosio;
+
+namespace {
+
+   const name self = "wraplock"_n;
+   const name bridge_contract = "bridge"_n;
+   const name token_contract = "eosio.token"_n;
+   const name wraptoken_contract = "wraptoken"_n;
+   const name depositor = "alice"_n;
+   const name beneficiary = "bob"_n;
+   const name prover = "prover"_n;
+
+   const symbol token_symbol = symbol("TOKEN", 4);
+   const int64_t amount = 10000;
+
+   // 2026-01-01T00:00:00, advanced by one block per transaction
+   uint64_t now = 1767225600000000ull;
+
+   struct options {
+      uint64_t deposits = 100000;
+      uint64_t withdrawals = 100000;
+      uint64_t batch = 1;
+      uint64_t cancels = 10000;
+      uint64_t reject_every = 0;
+      bool trace = false;
+   } opts;
+
+   uint64_t proof_checks = 0;
+   uint64_t failures = 0;
+   std::string last_failure;
+
+   checksum256 chain_id(){
+#ifdef WRAPLOCK_STATIC_CONFIG
+      return checksum256(config::chain_id);
+#else
+      return checksum256(std::array<uint8_t, 32>{ 1 });
+#endif
+   }
+
+   checksum256 paired_chain_id(){
+#ifdef WRAPLOCK_STATIC_CONFIG
+      return checksum256(config::paired_chain_id);
+#else
+      return checksum256(std::array<uint8_t, 32>{ 2 });
+#endif
+   }
+
+   name configured_bridge(){
+#ifdef WRAPLOCK_STATIC_CONFIG
+      return config::bridge_contract;
+#else
+      return bridge_contract;
+#endif
+   }
+
+   //runs an action on a fresh contract instance, as the dispatcher would, its tables being flushed on destruction
+   template<typename F>
+   void run_action(const name& code, const name& action_name, std::vector<char> data, const name& authorizer, const name& sender, F&& call){
+      mock::begin_action(self.value, code.value, action_name.value, data, { authorizer.value }, sender.value);
+      {
+         wraplock contract(self, code, datastream<const char*>(data.data(), data.size()));
+         call(contract);
+      }
+      mock::end_action();
+   }
+
+   //executes the inline actions sent by the transaction, in order: proof checks go to the bridge stub, proof removal
+   //runs on the contract, receipts and token transfers are only counted
+   void run_inline_actions(){
+
+      std::deque<std::vector<char>> pending;
+      for (auto& a : mock::take_inline_actions()) pending.push_back(std::move(a));
+
+      while (!pending.empty()) {
+
+         auto act = unpack<action>(pending.front());
+         pending.pop_front();
+
+         if (act.account == configured_bridge()) {
+            proof_checks++;
+            check(opts.reject_every == 0 || proof_checks % opts.reject_every != 0, "bridge stub rejected proof");
+         } else if (act.account == self && act.name == "clearproof"_n) {
+            run_action(self, act.name, act.data, self, self, []( wraplock& c ){ c.clearproof(); });
+            for (auto& a : mock::take_inline_actions()) pending.push_back(std::move(a));
+         }
+
+      }
+
+   }
+
+   //runs an action as a transaction of its own, rolling back its database writes if it or one of its inline actions fails
+   template<typename F>
+   bool transact(const name& code, const name& action_name, std::vector<char> data, const name& authorizer, const name& sender, F&& call){
+
+      now += 500000;
+      mock::set_time(now);
+      mock::begin_transaction();
+
+      try {
+         run_action(code, action_name, std::move(data), authorizer, sender, call);
+         run_inline_actions();
+         mock::commit_transaction();
+         return true;
+      } catch (const mock::assertion_failure& e) {
+         mock::rollback_transaction();
+         failures++;
+         last_failure = e.what();
+         return false;
+      }
+
+   }
+
+   //proof of an `emitxfer` receipt of the wraptoken contract, numbered by its global sequence
+   bridge::actionproof xfer_proof(const uint64_t global_sequence){
+
+      wraplock::xfer x = {
+         .owner = beneficiary,
+         .quantity = extended_asset(asset(amount, token_symbol), token_contract),
+         .beneficiary = depositor
+      };
+
+      bridge::actionproof proof;
+      proof.action.account = wraptoken_contract;
+      proof.action.name = "emitxfer"_n;
+      proof.action.authorization.emplace_back(wraptoken_contract, "active"_n);
+      proof.action.data = pack(x);
+      proof.receipt.receiver = wraptoken_contract;
+      proof.receipt.global_sequence = global_sequence;
+      proof.amproofpath.resize(8);
+
+      return proof;
+
+   }
+
+   bridge::lightproof light_proof(const uint64_t block_time){
+
+      bridge::lightproof proof;
+      proof.chain_id = paired_chain_id();
+      proof.header.timestamp = block_timestamp(time_point(microseconds(block_time)));
+      proof.header.producer = "producer"_n;
+      proof.bmproofpath.resize(16);
+
+      return proof;
+
+   }
+
+   bridge::heavyproof heavy_proof(const uint64_t block_time){
+
+      bridge::heavyproof proof;
+      proof.chain_id = paired_chain_id();
+      proof.hashes.resize(16);
+      proof.blocktoprove.block.header.timestamp = block_timestamp(time_point(microseconds(block_time)));
+      proof.blocktoprove.block.header.producer = "producer"_n;
+
+      return proof;
+
+   }
+
+   // times a phase and reports the intrinsic counters it consumed
+   struct phase {
+
+      const char* label;
+      uint64_t transactions = 0;
+      uint64_t failures_before = failures;
+      mock::counters before = mock::stats();
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      ~phase(){
+         double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+         const auto& after = mock::stats();
+         uint64_t tx = transactions ? transactions : 1;
+         printf("%-12s %10" PRIu64 " tx %8" PRIu64 " failed %10.3f s %12.0f tx/s %8.2f reads/tx %8.2f writes/tx %8.2f allocs/tx %10.1f bytes/tx\n",
+            label, transactions, failures - failures_before, seconds, seconds > 0 ? transactions / seconds : 0,
+            double(after.db_reads - before.db_reads) / tx, double(after.db_writes - before.db_writes) / tx,
+            double(after.allocations - before.allocations) / tx, double(after.allocated_bytes - before.allocated_bytes) / tx);
+      }
+
+   };
+
+   void parse_options(int argc, char** argv){
+
+      for (int i = 1; i < argc; i++) {
+         std::string arg = argv[i];
+         auto value = [&](){
+            if (i + 1 >= argc) { fprintf(stderr, "missing value for %s\n", arg.c_str()); exit(1); }
+            return strtoull(argv[++i], nullptr, 10);
+         };
+         if (arg == "--deposits") opts.deposits = value();
+         else if (arg == "--withdrawals") opts.withdrawals = value();
+         else if (arg == "--batch") opts.batch = value();
+         else if (arg == "--cancels") opts.cancels = value();
+         else if (arg == "--reject-every") opts.reject_every = value();
+         else if (arg == "--trace") opts.trace = true;
+         else {
+            fprintf(stderr, "usage: %s [--deposits N] [--withdrawals N] [--batch N] [--cancels N] [--reject-every N] [--trace]\n", argv[0]);
+            exit(1);
+         }
+      }
+
+      if (opts.batch == 0) opts.batch = 1;
+
+   }
+
+   void setup(){
+
+      mock::add_account(self.value);
+      mock::add_account(configured_bridge().value);
+      mock::add_account(token_contract.value);
+
+      bool ok = transact(self, "init"_n, pack(std::make_tuple(chain_id(), configured_bridge(), paired_chain_id())), self, self, []( wraplock& c ){
+         c.init(chain_id(), configured_bridge(), paired_chain_id());
+      });
+      ok = ok && transact(self, "addcontract"_n, pack(std::make_tuple(token_contract, wraptoken_contract)), self, self, []( wraplock& c ){
+         c.addcontract(token_contract, wraptoken_contract, binary_extension<name>());
+      });
+      ok = ok && transact(self, "enable"_n, {}, self, self, []( wraplock& c ){ c.enable(); });
+
+      if (!ok) {
+         fprintf(stderr, "setup failed: %s\n", last_failure.c_str());
+         exit(1);
+      }
+
+   }
+
+   void deposits(){
+
+      phase p{ "deposit" };
+
+      const asset quantity(amount, token_symbol);
+      const std::string memo = beneficiary.to_string();
+      const auto data = pack(std::make_tuple(depositor, self, quantity, memo));
+
+      for (uint64_t i = 0; i < opts.deposits; i++) {
+         //transfer notification from the native token contract
+         transact(token_contract, "transfer"_n, data, depositor, token_contract, [&]( wraplock& c ){
+            c.deposit(depositor, self, quantity, memo);
+         });
+         p.transactions++;
+      }
+
+   }
+
+   uint64_t global_sequence = 1;
+
+   // global sequence of a receipt accepted by a withdrawal, proven again by `replay`
+   uint64_t proven_sequence = 0;
+
+   void withdrawals(){
+
+      phase p{ opts.batch > 1 ? "withdrawbatb" : "withdrawb" };
+
+      for (uint64_t i = 0; i < opts.withdrawals; i += opts.batch) {
+
+         auto blockproof = light_proof(now);
+
+         if (opts.batch > 1) {
+            std::vector<bridge::actionproof> actionproofs;
+            for (uint64_t j = i; j < std::min(i + opts.batch, opts.withdrawals); j++) actionproofs.push_back(xfer_proof(global_sequence++));
+            bool ok = transact(self, "withdrawbatb"_n, pack(std::make_tuple(prover, blockproof, actionproofs)), prover, prover, [&]( wraplock& c ){
+               c.withdrawbatb(prover, blockproof, actionproofs);
+            });
+            if (ok && !proven_sequence) proven_sequence = actionproofs[0].receipt.global_sequence;
+         } else {
+            auto actionproof = xfer_proof(global_sequence++);
+            bool ok = transact(self, "withdrawb"_n, pack(std::make_tuple(prover, blockproof, actionproof)), prover, prover, [&]( wraplock& c ){
+               c.withdrawb(prover, blockproof, actionproof);
+            });
+            if (ok && !proven_sequence) proven_sequence = actionproof.receipt.global_sequence;
+         }
+
+         p.transactions++;
+
+      }
+
+   }
+
+   void cancels(){
+
+      phase p{ "cancela" };
+
+      for (uint64_t i = 0; i < opts.cancels; i++) {
+
+         //proven block must be older than the 15 minute cancel delay
+         auto blockproof = heavy_proof(now - 1200000000ull);
+         auto actionproof = xfer_proof(global_sequence++);
+
+         transact(self, "cancela"_n, pack(std::make_tuple(prover, blockproof, actionproof)), prover, prover, [&]( wraplock& c ){
+            c.cancela(prover, blockproof, actionproof);
+         });
+
+         p.transactions++;
+
+      }
+
+   }
+
+   //a receipt accepted by a withdrawal must be refused when proven again
+   void replay(){
+
+      if (!proven_sequence) return;
+
+      uint64_t rejected_before = opts.reject_every;
+      opts.reject_every = 0;
+
+      auto blockproof = light_proof(now);
+      auto actionproof = xfer_proof(proven_sequence);
+      bool accepted = transact(self, "withdrawb"_n, pack(std::make_tuple(prover, blockproof, actionproof)), prover, prover, [&]( wraplock& c ){
+         c.withdrawb(prover, blockproof, actionproof);
+      });
+
+      opts.reject_every = rejected_before;
+
+      printf("replay       %s (%s)\n", accepted ? "ACCEPTED" : "refused", accepted ? "receipt proven twice" : last_failure.c_str());
+
+      if (accepted) exit(1);
+
+   }
+
+}
+
+int main(int argc, char** argv){
+
+   parse_options(argc, argv);
+
+   mock::set_console(opts.trace);
+
+   setup();
+
+   deposits();
+   withdrawals();
+   cancels();
+   replay();
+
+   const auto& stats = mock::stats();
+   printf("total        %" PRIu64 " rows, %" PRIu64 " proof checks, %" PRIu64 " inline actions, %" PRIu64 " failed transactions%s%s\n",
+      mock::row_count(), proof_checks, stats.inline_actions, failures,
+      failures ? ", last: " : "", failures ? last_failure.c_str() : "");
+
+   return 0;
+
+}
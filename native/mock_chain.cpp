@@ -0,0 +1,736 @@
+#include <mock_chain.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <new>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+
+//this file implements the intrinsics with C linkage and plain types, without including the CDT headers which declare
+//them, so it is compiled as ordinary host code
+
+namespace {
+
+   using uint128_t = unsigned __int128;
+
+   // code, scope and table of a database table
+   using table_key = std::tuple<uint64_t, uint64_t, uint64_t>;
+
+   mock::counters stats;
+
+   bool console = false;
+
+   // current action
+   uint64_t receiver = 0;
+   uint64_t code = 0;
+   uint64_t action_name = 0;
+   uint64_t sender = 0;
+   uint64_t now = 0;
+   std::vector<char> action_data;
+   std::vector<uint64_t> authorizers;
+   std::set<uint64_t> accounts;
+
+   std::vector<std::vector<char>> inline_actions;
+   std::vector<char> return_value;
+
+   // undo records of the current transaction, replayed in reverse by rollback_transaction
+   std::vector<std::function<void()>> undo_log;
+
+   void journal(std::function<void()> undo){
+      undo_log.push_back(std::move(undo));
+   }
+
+   void fail(const char* msg){
+      throw mock::assertion_failure(msg);
+   }
+
+   // primary (i64) tables. Iterators index `itrs` for rows and encode end iterators as -(index into `ends` + 2)
+   struct primary_row {
+      uint64_t            payer;
+      std::vector<char>   data;
+   };
+
+   struct primary_store {
+
+      std::map<table_key, std::map<uint64_t, primary_row>> tables;
+
+      std::vector<std::pair<table_key, uint64_t>> itrs;
+      std::map<std::pair<table_key, uint64_t>, int32_t> itr_lookup;
+      std::vector<table_key> ends;
+
+      void reset_iterators(){
+         itrs.clear();
+         itr_lookup.clear();
+         ends.clear();
+      }
+
+      int32_t iterator(const table_key& t, uint64_t primary){
+         auto key = std::make_pair(t, primary);
+         auto found = itr_lookup.find(key);
+         if (found != itr_lookup.end()) return found->second;
+         itrs.push_back(key);
+         return itr_lookup[key] = int32_t(itrs.size() - 1);
+      }
+
+      int32_t end(const table_key& t){
+         auto found = std::find(ends.begin(), ends.end(), t);
+         if (found != ends.end()) return -int32_t(found - ends.begin()) - 2;
+         ends.push_back(t);
+         return -int32_t(ends.size() - 1) - 2;
+      }
+
+      const std::pair<table_key, uint64_t>& at(int32_t itr){
+         if (itr < 0 || size_t(itr) >= itrs.size()) fail("invalid iterator");
+         return itrs[itr];
+      }
+
+      primary_row& row(int32_t itr){
+         const auto& [t, primary] = at(itr);
+         auto table = tables.find(t);
+         if (table == tables.end()) fail("iterator to removed row");
+         auto r = table->second.find(primary);
+         if (r == table->second.end()) fail("iterator to removed row");
+         return r->second;
+      }
+
+      int32_t position(const table_key& t, std::map<uint64_t, primary_row>::iterator r){
+         const auto& rows = tables[t];
+         return r == rows.end() ? end(t) : iterator(t, r->first);
+      }
+
+   } primary;
+
+   // secondary indexes, as ordered (secondary, primary) pairs along with the secondary of each primary key
+   template<typename K>
+   struct secondary_store {
+
+      struct table {
+         std::set<std::pair<K, uint64_t>>                      ordered;
+         std::map<uint64_t, std::pair<K, uint64_t>>            by_primary;   // secondary and payer
+      };
+
+      std::map<table_key, table> tables;
+
+      std::vector<std::pair<table_key, std::pair<K, uint64_t>>> itrs;
+      std::vector<table_key> ends;
+
+      void reset_iterators(){
+         itrs.clear();
+         ends.clear();
+      }
+
+      int32_t iterator(const table_key& t, const std::pair<K, uint64_t>& entry){
+         itrs.emplace_back(t, entry);
+         return int32_t(itrs.size() - 1);
+      }
+
+      int32_t end(const table_key& t){
+         auto found = std::find(ends.begin(), ends.end(), t);
+         if (found != ends.end()) return -int32_t(found - ends.begin()) - 2;
+         ends.push_back(t);
+         return -int32_t(ends.size() - 1) - 2;
+      }
+
+      const std::pair<table_key, std::pair<K, uint64_t>>& at(int32_t itr){
+         if (itr < 0 || size_t(itr) >= itrs.size()) fail("invalid secondary iterator");
+         return itrs[itr];
+      }
+
+      int32_t position(const table_key& t, typename std::set<std::pair<K, uint64_t>>::iterator e, uint64_t* primary){
+         auto& ordered = tables[t].ordered;
+         if (e == ordered.end()) return end(t);
+         *primary = e->second;
+         return iterator(t, *e);
+      }
+
+      void insert(const table_key& t, uint64_t id, const K& secondary, uint64_t payer){
+         auto& tab = tables[t];
+         tab.ordered.emplace(secondary, id);
+         tab.by_primary[id] = { secondary, payer };
+      }
+
+      void erase(const table_key& t, uint64_t id){
+         auto& tab = tables[t];
+         auto found = tab.by_primary.find(id);
+         if (found == tab.by_primary.end()) return;
+         tab.ordered.erase({ found->second.first, id });
+         tab.by_primary.erase(found);
+      }
+
+      int32_t store(uint64_t scope, uint64_t table_name, uint64_t payer, uint64_t id, const K& secondary){
+         table_key t{ receiver, scope, table_name };
+         if (tables[t].by_primary.count(id)) fail("secondary key already exists");
+         insert(t, id, secondary, payer);
+         journal([this, t, id]{ erase(t, id); });
+         stats.db_writes++;
+         return iterator(t, { secondary, id });
+      }
+
+      void update(int32_t itr, uint64_t payer, const K& secondary){
+         auto [t, entry] = at(itr);
+         if (std::get<0>(t) != receiver) fail("db access violation");
+         auto previous = tables[t].by_primary.at(entry.second);
+         erase(t, entry.second);
+         insert(t, entry.second, secondary, payer);
+         journal([this, t, id = entry.second, previous]{ erase(t, id); insert(t, id, previous.first, previous.second); });
+         itrs[itr].second.first = secondary;
+         stats.db_writes++;
+      }
+
+      void remove(int32_t itr){
+         auto [t, entry] = at(itr);
+         if (std::get<0>(t) != receiver) fail("db access violation");
+         auto previous = tables[t].by_primary.at(entry.second);
+         erase(t, entry.second);
+         journal([this, t, id = entry.second, previous]{ insert(t, id, previous.first, previous.second); });
+         stats.db_writes++;
+      }
+
+      int32_t next(int32_t itr, uint64_t* primary){
+         stats.db_reads++;
+         if (itr < -1) return itr;
+         auto [t, entry] = at(itr);
+         auto& ordered = tables[t].ordered;
+         return position(t, ordered.upper_bound(entry), primary);
+      }
+
+      int32_t previous(int32_t itr, uint64_t* primary){
+         stats.db_reads++;
+         if (itr == -1) return -1;
+         table_key t;
+         typename std::set<std::pair<K, uint64_t>>::iterator e;
+         if (itr < -1) {
+            t = ends.at(-itr - 2);
+            e = tables[t].ordered.end();
+         } else {
+            auto [tk, entry] = at(itr);
+            t = tk;
+            e = tables[t].ordered.lower_bound(entry);
+         }
+         if (e == tables[t].ordered.begin()) return -1;
+         --e;
+         *primary = e->second;
+         return iterator(t, *e);
+      }
+
+      int32_t find_primary(uint64_t c, uint64_t scope, uint64_t table_name, K* secondary, uint64_t primary){
+         stats.db_reads++;
+         table_key t{ c, scope, table_name };
+         auto& tab = tables[t];
+         auto found = tab.by_primary.find(primary);
+         if (found == tab.by_primary.end()) return end(t);
+         *secondary = found->second.first;
+         return iterator(t, { found->second.first, primary });
+      }
+
+      int32_t find_secondary(uint64_t c, uint64_t scope, uint64_t table_name, const K& secondary, uint64_t* primary){
+         stats.db_reads++;
+         table_key t{ c, scope, table_name };
+         auto& ordered = tables[t].ordered;
+         auto e = ordered.lower_bound({ secondary, 0 });
+         if (e == ordered.end() || !(e->first == secondary)) return end(t);
+         return position(t, e, primary);
+      }
+
+      int32_t lowerbound(uint64_t c, uint64_t scope, uint64_t table_name, K* secondary, uint64_t* primary){
+         stats.db_reads++;
+         table_key t{ c, scope, table_name };
+         auto& ordered = tables[t].ordered;
+         auto e = ordered.lower_bound({ *secondary, 0 });
+         if (e != ordered.end()) *secondary = e->first;
+         return position(t, e, primary);
+      }
+
+      int32_t upperbound(uint64_t c, uint64_t scope, uint64_t table_name, K* secondary, uint64_t* primary){
+         stats.db_reads++;
+         table_key t{ c, scope, table_name };
+         auto& ordered = tables[t].ordered;
+         auto e = ordered.upper_bound({ *secondary, UINT64_MAX });
+         if (e != ordered.end()) *secondary = e->first;
+         return position(t, e, primary);
+      }
+
+      int32_t end_of(uint64_t c, uint64_t scope, uint64_t table_name){
+         return end({ c, scope, table_name });
+      }
+
+   };
+
+   secondary_store<uint64_t> idx64;
+   secondary_store<std::array<uint128_t, 2>> idx256;
+
+   std::array<uint128_t, 2> key256(const uint128_t* data, uint32_t data_len){
+      if (data_len != 2) fail("invalid key256 length");
+      return { data[0], data[1] };
+   }
+
+   // SHA-256 (FIPS 180-4)
+   struct sha256_state {
+
+      uint32_t h[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+      static uint32_t rotr(uint32_t x, int n){ return (x >> n) | (x << (32 - n)); }
+
+      void block(const uint8_t* p){
+
+         static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+         };
+
+         uint32_t w[64];
+         for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t(p[4 * i]) << 24) | (uint32_t(p[4 * i + 1]) << 16) | (uint32_t(p[4 * i + 2]) << 8) | uint32_t(p[4 * i + 3]);
+         }
+         for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+         }
+
+         uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+         for (int i = 0; i < 64; i++) {
+            uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+         }
+         h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+
+      }
+
+      void digest(const uint8_t* data, size_t len, uint8_t* out){
+
+         size_t full = len / 64 * 64;
+         for (size_t i = 0; i < full; i += 64) block(data + i);
+
+         uint8_t tail[128] = {};
+         size_t rest = len - full;
+         memcpy(tail, data + full, rest);
+         tail[rest] = 0x80;
+         size_t tail_len = rest + 9 <= 64 ? 64 : 128;
+         uint64_t bits = uint64_t(len) * 8;
+         for (int i = 0; i < 8; i++) tail[tail_len - 1 - i] = uint8_t(bits >> (8 * i));
+         for (size_t i = 0; i < tail_len; i += 64) block(tail + i);
+
+         for (int i = 0; i < 8; i++) {
+            out[4 * i] = uint8_t(h[i] >> 24);
+            out[4 * i + 1] = uint8_t(h[i] >> 16);
+            out[4 * i + 2] = uint8_t(h[i] >> 8);
+            out[4 * i + 3] = uint8_t(h[i]);
+         }
+
+      }
+
+   };
+
+   std::string name_to_string(uint64_t value){
+      static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
+      std::string str(13, '.');
+      uint64_t tmp = value;
+      for (int i = 0; i <= 12; i++) {
+         char c = charmap[tmp & (i == 0 ? 0x0f : 0x1f)];
+         str[12 - i] = c;
+         tmp >>= (i == 0 ? 4 : 5);
+      }
+      str.erase(str.find_last_not_of('.') + 1);
+      return str;
+   }
+
+}
+
+// heap allocations are counted for the load test report
+void* operator new(size_t size){
+   stats.allocations++;
+   stats.allocated_bytes += size;
+   if (void* ptr = malloc(size ? size : 1)) return ptr;
+   throw std::bad_alloc();
+}
+void* operator new[](size_t size){ return operator new(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+
+namespace mock {
+
+   void begin_transaction(){
+      undo_log.clear();
+      inline_actions.clear();
+   }
+
+   void commit_transaction(){
+      undo_log.clear();
+   }
+
+   void rollback_transaction(){
+      for (auto itr = undo_log.rbegin(); itr != undo_log.rend(); ++itr) (*itr)();
+      undo_log.clear();
+      inline_actions.clear();
+      end_action();
+   }
+
+   void begin_action(uint64_t r, uint64_t c, uint64_t a, std::vector<char> data, std::vector<uint64_t> auths, uint64_t s){
+      receiver = r;
+      code = c;
+      action_name = a;
+      action_data = std::move(data);
+      authorizers = std::move(auths);
+      sender = s;
+      return_value.clear();
+   }
+
+   void end_action(){
+      primary.reset_iterators();
+      idx64.reset_iterators();
+      idx256.reset_iterators();
+   }
+
+   std::vector<std::vector<char>> take_inline_actions(){
+      return std::exchange(inline_actions, {});
+   }
+
+   std::vector<char> take_return_value(){
+      return std::exchange(return_value, {});
+   }
+
+   void set_time(uint64_t microseconds){ now = microseconds; }
+   void add_account(uint64_t account){ accounts.insert(account); }
+   void set_console(bool enabled){ console = enabled; }
+
+   const counters& stats(){ return ::stats; }
+
+   uint64_t row_count(){
+      uint64_t rows = 0;
+      for (const auto& t : primary.tables) rows += t.second.size();
+      return rows;
+   }
+
+}
+
+extern "C" {
+
+   // assertions
+
+   void eosio_assert(uint32_t test, const char* msg){
+      if (!test) fail(msg);
+   }
+
+   void eosio_assert_message(uint32_t test, const char* msg, uint32_t msg_len){
+      if (!test) throw mock::assertion_failure(std::string(msg, msg_len));
+   }
+
+   void eosio_assert_code(uint32_t test, uint64_t error_code){
+      if (!test) throw mock::assertion_failure("assertion failure with error code " + std::to_string(error_code));
+   }
+
+   // action
+
+   uint32_t read_action_data(void* msg, uint32_t len){
+      uint32_t size = std::min<uint32_t>(len, action_data.size());
+      memcpy(msg, action_data.data(), size);
+      return size;
+   }
+
+   uint32_t action_data_size(){
+      return action_data.size();
+   }
+
+   void require_auth(uint64_t name){
+      if (std::find(authorizers.begin(), authorizers.end(), name) == authorizers.end()) {
+         fail(("missing authority of " + name_to_string(name)).c_str());
+      }
+   }
+
+   void require_auth2(uint64_t name, uint64_t){
+      require_auth(name);
+   }
+
+   bool has_auth(uint64_t name){
+      return std::find(authorizers.begin(), authorizers.end(), name) != authorizers.end();
+   }
+
+   bool is_account(uint64_t name){
+      return accounts.count(name) > 0;
+   }
+
+   void require_recipient(uint64_t){
+   }
+
+   void send_inline(char* serialized_action, size_t size){
+      stats.inline_actions++;
+      inline_actions.emplace_back(serialized_action, serialized_action + size);
+   }
+
+   void send_context_free_inline(char* serialized_action, size_t size){
+      send_inline(serialized_action, size);
+   }
+
+   uint64_t current_receiver(){
+      return receiver;
+   }
+
+   uint64_t get_sender(){
+      return sender;
+   }
+
+   void set_action_return_value(void* data, size_t size){
+      return_value.assign((char*)data, (char*)data + size);
+   }
+
+   uint64_t current_time(){
+      return now;
+   }
+
+   uint64_t publication_time(){
+      return now;
+   }
+
+   // crypto
+
+   void sha256(const char* data, uint32_t length, void* hash){
+      sha256_state().digest((const uint8_t*)data, length, (uint8_t*)hash);
+   }
+
+   void assert_sha256(const char* data, uint32_t length, const void* hash){
+      uint8_t computed[32];
+      sha256_state().digest((const uint8_t*)data, length, computed);
+      if (memcmp(computed, hash, 32) != 0) fail("hash mismatch");
+   }
+
+   // console
+
+   void prints(const char* cstr){
+      if (console) fputs(cstr, stdout);
+   }
+
+   void prints_l(const char* cstr, uint32_t len){
+      if (console) fwrite(cstr, 1, len, stdout);
+   }
+
+   void printi(int64_t value){
+      if (console) printf("%" PRId64, value);
+   }
+
+   void printui(uint64_t value){
+      if (console) printf("%" PRIu64, value);
+   }
+
+   void printi128(const __int128* value){
+      if (console) printf("%" PRId64, int64_t(*value));
+   }
+
+   void printui128(const unsigned __int128* value){
+      if (console) printf("%" PRIu64, uint64_t(*value));
+   }
+
+   void printsf(float value){
+      if (console) printf("%g", value);
+   }
+
+   void printdf(double value){
+      if (console) printf("%g", value);
+   }
+
+   void printqf(const long double* value){
+      if (console) printf("%Lg", *value);
+   }
+
+   void printn(uint64_t name){
+      if (console) fputs(name_to_string(name).c_str(), stdout);
+   }
+
+   void printhex(const void* data, uint32_t datalen){
+      if (!console) return;
+      for (uint32_t i = 0; i < datalen; i++) printf("%02x", ((const uint8_t*)data)[i]);
+   }
+
+   // primary index
+
+   int32_t db_store_i64(uint64_t scope, uint64_t table, uint64_t payer, uint64_t id, const void* data, uint32_t len){
+      table_key t{ receiver, scope, table };
+      auto& rows = primary.tables[t];
+      if (rows.count(id)) fail("key already exists");
+      rows[id] = { payer, std::vector<char>((const char*)data, (const char*)data + len) };
+      journal([t, id]{ primary.tables[t].erase(id); });
+      stats.db_writes++;
+      return primary.iterator(t, id);
+   }
+
+   void db_update_i64(int32_t iterator, uint64_t payer, const void* data, uint32_t len){
+      auto t = primary.at(iterator).first;
+      if (std::get<0>(t) != receiver) fail("db access violation");
+      auto& row = primary.row(iterator);
+      journal([t, id = primary.at(iterator).second, previous = row]{ primary.tables[t][id] = previous; });
+      row.payer = payer;
+      row.data.assign((const char*)data, (const char*)data + len);
+      stats.db_writes++;
+   }
+
+   void db_remove_i64(int32_t iterator){
+      auto [t, id] = primary.at(iterator);
+      if (std::get<0>(t) != receiver) fail("db access violation");
+      journal([t = t, id = id, previous = primary.row(iterator)]{ primary.tables[t][id] = previous; });
+      primary.tables[t].erase(id);
+      stats.db_writes++;
+   }
+
+   int32_t db_get_i64(int32_t iterator, void* data, uint32_t len){
+      stats.db_reads++;
+      const auto& row = primary.row(iterator);
+      memcpy(data, row.data.data(), std::min<size_t>(len, row.data.size()));
+      return row.data.size();
+   }
+
+   int32_t db_next_i64(int32_t iterator, uint64_t* primary_key){
+      stats.db_reads++;
+      if (iterator < 0) return -1;
+      auto [t, id] = primary.at(iterator);
+      auto& rows = primary.tables[t];
+      auto next = rows.upper_bound(id);
+      if (next != rows.end()) *primary_key = next->first;
+      return primary.position(t, next);
+   }
+
+   int32_t db_previous_i64(int32_t iterator, uint64_t* primary_key){
+      stats.db_reads++;
+      if (iterator == -1) return -1;
+      table_key t = iterator < -1 ? primary.ends.at(-iterator - 2) : primary.at(iterator).first;
+      auto& rows = primary.tables[t];
+      auto r = iterator < -1 ? rows.end() : rows.lower_bound(primary.at(iterator).second);
+      if (r == rows.begin()) return -1;
+      --r;
+      *primary_key = r->first;
+      return primary.iterator(t, r->first);
+   }
+
+   int32_t db_find_i64(uint64_t c, uint64_t scope, uint64_t table, uint64_t id){
+      stats.db_reads++;
+      table_key t{ c, scope, table };
+      auto& rows = primary.tables[t];
+      return primary.position(t, rows.find(id));
+   }
+
+   int32_t db_lowerbound_i64(uint64_t c, uint64_t scope, uint64_t table, uint64_t id){
+      stats.db_reads++;
+      table_key t{ c, scope, table };
+      return primary.position(t, primary.tables[t].lower_bound(id));
+   }
+
+   int32_t db_upperbound_i64(uint64_t c, uint64_t scope, uint64_t table, uint64_t id){
+      stats.db_reads++;
+      table_key t{ c, scope, table };
+      return primary.position(t, primary.tables[t].upper_bound(id));
+   }
+
+   int32_t db_end_i64(uint64_t c, uint64_t scope, uint64_t table){
+      return primary.end({ c, scope, table });
+   }
+
+   // uint64_t secondary index
+
+   int32_t db_idx64_store(uint64_t scope, uint64_t table, uint64_t payer, uint64_t id, const uint64_t* secondary){
+      return idx64.store(scope, table, payer, id, *secondary);
+   }
+
+   void db_idx64_update(int32_t iterator, uint64_t payer, const uint64_t* secondary){
+      idx64.update(iterator, payer, *secondary);
+   }
+
+   void db_idx64_remove(int32_t iterator){
+      idx64.remove(iterator);
+   }
+
+   int32_t db_idx64_next(int32_t iterator, uint64_t* primary_key){
+      return idx64.next(iterator, primary_key);
+   }
+
+   int32_t db_idx64_previous(int32_t iterator, uint64_t* primary_key){
+      return idx64.previous(iterator, primary_key);
+   }
+
+   int32_t db_idx64_find_primary(uint64_t c, uint64_t scope, uint64_t table, uint64_t* secondary, uint64_t primary_key){
+      return idx64.find_primary(c, scope, table, secondary, primary_key);
+   }
+
+   int32_t db_idx64_find_secondary(uint64_t c, uint64_t scope, uint64_t table, const uint64_t* secondary, uint64_t* primary_key){
+      return idx64.find_secondary(c, scope, table, *secondary, primary_key);
+   }
+
+   int32_t db_idx64_lowerbound(uint64_t c, uint64_t scope, uint64_t table, uint64_t* secondary, uint64_t* primary_key){
+      return idx64.lowerbound(c, scope, table, secondary, primary_key);
+   }
+
+   int32_t db_idx64_upperbound(uint64_t c, uint64_t scope, uint64_t table, uint64_t* secondary, uint64_t* primary_key){
+      return idx64.upperbound(c, scope, table, secondary, primary_key);
+   }
+
+   int32_t db_idx64_end(uint64_t c, uint64_t scope, uint64_t table){
+      return idx64.end_of(c, scope, table);
+   }
+
+   // checksum256 secondary index, passed as two uint128 words
+
+   int32_t db_idx256_store(uint64_t scope, uint64_t table, uint64_t payer, uint64_t id, const uint128_t* data, uint32_t data_len){
+      return idx256.store(scope, table, payer, id, key256(data, data_len));
+   }
+
+   void db_idx256_update(int32_t iterator, uint64_t payer, const uint128_t* data, uint32_t data_len){
+      idx256.update(iterator, payer, key256(data, data_len));
+   }
+
+   void db_idx256_remove(int32_t iterator){
+      idx256.remove(iterator);
+   }
+
+   int32_t db_idx256_next(int32_t iterator, uint64_t* primary_key){
+      return idx256.next(iterator, primary_key);
+   }
+
+   int32_t db_idx256_previous(int32_t iterator, uint64_t* primary_key){
+      return idx256.previous(iterator, primary_key);
+   }
+
+   int32_t db_idx256_find_primary(uint64_t c, uint64_t scope, uint64_t table, uint128_t* data, uint32_t data_len, uint64_t primary_key){
+      std::array<uint128_t, 2> secondary;
+      int32_t itr = idx256.find_primary(c, scope, table, &secondary, primary_key);
+      if (itr >= 0 && data_len >= 2) { data[0] = secondary[0]; data[1] = secondary[1]; }
+      return itr;
+   }
+
+   int32_t db_idx256_find_secondary(uint64_t c, uint64_t scope, uint64_t table, const uint128_t* data, uint32_t data_len, uint64_t* primary_key){
+      return idx256.find_secondary(c, scope, table, key256(data, data_len), primary_key);
+   }
+
+   int32_t db_idx256_lowerbound(uint64_t c, uint64_t scope, uint64_t table, uint128_t* data, uint32_t data_len, uint64_t* primary_key){
+      auto secondary = key256(data, data_len);
+      int32_t itr = idx256.lowerbound(c, scope, table, &secondary, primary_key);
+      data[0] = secondary[0]; data[1] = secondary[1];
+      return itr;
+   }
+
+   int32_t db_idx256_upperbound(uint64_t c, uint64_t scope, uint64_t table, uint128_t* data, uint32_t data_len, uint64_t* primary_key){
+      auto secondary = key256(data, data_len);
+      int32_t itr = idx256.upperbound(c, scope, table, &secondary, primary_key);
+      data[0] = secondary[0]; data[1] = secondary[1];
+      return itr;
+   }
+
+   int32_t db_idx256_end(uint64_t c, uint64_t scope, uint64_t table){
+      return idx256.end_of(c, scope, table);
+   }
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// in-memory stand-in for the chain, providing the intrinsics the wraplock contract imports (database, action data,
+// authorization, inline actions, time, sha256, console) to the WRAPLOCK_NATIVE host build - see native/loadtest.cpp
+namespace mock {
+
+   // thrown by eosio_assert, so a failed `check` aborts the transaction like it would on chain
+   struct assertion_failure : std::runtime_error {
+      using std::runtime_error::runtime_error;
+   };
+
+   // counters of intrinsic calls and heap allocations since the start of the process
+   struct counters {
+      uint64_t db_reads = 0;
+      uint64_t db_writes = 0;
+      uint64_t inline_actions = 0;
+      uint64_t allocations = 0;
+      uint64_t allocated_bytes = 0;
+   };
+
+   // transactions journal database writes so that a failed one can be rolled back
+   void begin_transaction();
+   void commit_transaction();
+   void rollback_transaction();
+
+   // makes an action current: its receiver, the code it was sent to, its serialized data, the accounts that authorized
+   // it and the account returned by get_sender(). Database iterators are only valid until `end_action`
+   void begin_action(uint64_t receiver, uint64_t code, uint64_t action, std::vector<char> data,
+                     std::vector<uint64_t> authorizers, uint64_t sender = 0);
+   void end_action();
+
+   // inline actions sent by the current transaction (serialized eosio::action), and the return value of the last action
+   std::vector<std::vector<char>> take_inline_actions();
+   std::vector<char> take_return_value();
+
+   void set_time(uint64_t microseconds);
+   void add_account(uint64_t account);
+   void set_console(bool enabled);
+
+   const counters& stats();
+   uint64_t row_count();
+
+}
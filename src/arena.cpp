@@ -0,0 +1,73 @@
+#include <eosio/eosio.hpp>
+#include <eosio/action.hpp>
+
+#include <cstdlib>
+#include <new>
+
+#include <arena.hpp>
+
+#ifdef WRAPLOCK_ARENA_ALLOCATOR
+
+//bump allocator serving every operator new of an action from a single block, reserved on first use and sized from the
+//incoming action data, so deserializing and handing on large proofs grows linear memory once instead of per vector.
+//nothing is released before the end of the action, allocations that don't fit fall back to malloc
+namespace {
+
+   constexpr size_t ARENA_BASE_SIZE = 16 * 1024;
+   constexpr size_t ARENA_SIZE_FACTOR = 4;
+
+   char* arena_begin = nullptr;
+   char* arena_next = nullptr;
+   char* arena_end = nullptr;
+
+   void* arena_alloc(size_t size) {
+
+      if (arena_begin == nullptr) {
+         size_t reserve = ARENA_BASE_SIZE + ARENA_SIZE_FACTOR * eosio::action_data_size();
+         arena_begin = arena_next = (char*)malloc(reserve);
+         arena_end = arena_begin + reserve;
+      }
+
+      size = (size + 7) & ~size_t(7);
+
+      if (size > size_t(arena_end - arena_next)) return malloc(size);
+
+      void* ptr = arena_next;
+      arena_next += size;
+
+      return ptr;
+
+   }
+
+   void arena_free(void* ptr) {
+
+      if ((char*)ptr >= arena_begin && (char*)ptr < arena_end) return;
+
+      free(ptr);
+
+   }
+
+}
+
+void* operator new(size_t size) { return arena_alloc(size); }
+void* operator new[](size_t size) { return arena_alloc(size); }
+void operator delete(void* ptr) noexcept { arena_free(ptr); }
+void operator delete[](void* ptr) noexcept { arena_free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { arena_free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { arena_free(ptr); }
+
+#endif
+
+namespace eosio {
+
+void print_memory_stats(){
+
+    print("memory pages: ", uint64_t(__builtin_wasm_memory_size(0)));
+#ifdef WRAPLOCK_ARENA_ALLOCATOR
+    print(", arena used: ", uint64_t(arena_next - arena_begin), "/", uint64_t(arena_end - arena_begin));
+#endif
+    print("\n");
+
+}
+
+} /// namespace eosio
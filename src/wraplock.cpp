@@ -3,316 +3,1543 @@
 namespace eosio {
 
 
+//returns true if the receipt digest was recorded before replay protection moved to the `replay` table
+bool wraplock::is_legacy_processed(const bridge::actreceipt& receipt){
+
+    //the legacy digest table only holds proofs of the default chain
+    if (route().scope != _self) return false;
+
+    if (_processedtable.begin() == _processedtable.end()) return false;
+
+    checksum256 action_receipt_digest = receipt.digest();
+
+    auto pid_index = _processedtable.get_index<"digest"_n>();
+
+    return pid_index.find(action_receipt_digest) != pid_index.end();
+
+}
+
+//returns true if the action receipt has already been accepted as proof
+bool wraplock::is_processed(const bridge::actreceipt& receipt){
+
+    auto page = replay_table().find( receipt.global_sequence / REPLAY_PAGE_BITS );
+
+    if (page != replay_table().end()) {
+        uint64_t bit = receipt.global_sequence % REPLAY_PAGE_BITS;
+        if ((page->bits[bit / 64] >> (bit % 64)) & 1) return true;
+    }
+
+    return is_legacy_processed(receipt);
+
+}
+
+//sets the replay bit of a global sequence, creating its page if needed
+void wraplock::mark_processed(const uint64_t global_sequence, const block_timestamp& block_time, const name& payer){
+
+    uint64_t bit = global_sequence % REPLAY_PAGE_BITS;
+
+    auto page = replay_table().find( global_sequence / REPLAY_PAGE_BITS );
+
+    if (page == replay_table().end()) {
+        replay_table().emplace( payer, [&]( auto& p ) {
+            p.page = global_sequence / REPLAY_PAGE_BITS;
+            p.latest = block_time;
+            p.bits.resize(REPLAY_PAGE_WORDS);
+            p.bits[bit / 64] = uint64_t(1) << (bit % 64);
+        });
+    } else {
+        replay_table().modify( page, same_payer, [&]( auto& p ) {
+            if (block_time.slot > p.latest.slot) p.latest = block_time;
+            p.bits[bit / 64] |= uint64_t(1) << (bit % 64);
+        });
+    }
+
+}
+
 //adds a proof to the list of processed proofs (throws an exception if proof already exists)
-void wraplock::add_or_assert(const bridge::actionproof& actionproof, const name& payer){
+void wraplock::add_or_assert(const bridge::actionproof& actionproof, const block_timestamp& block_time, const name& payer){
+
+    //replay records of blocks older than the watermark may have been pruned
+    check(block_time.slot >= replay_state_table().get_or_default().watermark.slot, "proof is older than the replay watermark");
+
+    check(!is_processed(actionproof.receipt), "action already proved");
+
+    mark_processed(actionproof.receipt.global_sequence, block_time, payer);
+
+}
+
+#ifdef WRAPLOCK_STATIC_CONFIG
+
+//checks that the contract has been initialized, loading the built-in chain configuration and stored enabled flag
+//into the state cache
+void wraplock::check_initialized(){
+
+    if (_cached_global) return;
+
+    check(_status.exists(), "contract must be initialized first");
+
+    _cached_global = wraplock::global{
+        .chain_id = checksum256(config::chain_id),
+        .bridge_contract = config::bridge_contract,
+        .paired_chain_id = checksum256(config::paired_chain_id),
+        .enabled = _status.get().enabled
+    };
+
+}
+
+void wraplock::init(const checksum256& chain_id, const name& bridge_contract, const checksum256& paired_chain_id)
+{
+    check(!_status.exists(), "contract already initialized");
+
+    require_auth( _self );
+
+    check( chain_id == checksum256(config::chain_id), "chain_id does not match the built-in configuration" );
+    check( bridge_contract == config::bridge_contract, "bridge_contract does not match the built-in configuration" );
+    check( paired_chain_id == checksum256(config::paired_chain_id), "paired_chain_id does not match the built-in configuration" );
+
+    check( is_account( bridge_contract ), "bridge_contract account does not exist" );
+
+    _status.set(wraplock::status{ .enabled = false }, _self);
+
+}
+
+#else
+
+//checks that the contract has been initialized, loading the configuration written by `init` into the state cache
+void wraplock::check_initialized(){
+
+    if (_cached_global) return;
+
+    check(global_config.exists(), "contract must be initialized first");
+
+    _cached_global = global_config.get();
+
+}
+
+void wraplock::init(const checksum256& chain_id, const name& bridge_contract, const checksum256& paired_chain_id)
+{
+    check(!global_config.exists(), "contract already initialized");
+
+    require_auth( _self );
+
+    check( is_account( bridge_contract ), "bridge_contract account does not exist" );
+
+    auto global = global_config.get_or_create(_self, globalrow);
+    global.chain_id = chain_id;
+    global.bridge_contract = bridge_contract;
+    global.paired_chain_id = paired_chain_id;
+    global.enabled = false;
+    global_config.set(global, _self);
+
+}
+
+#endif
+
+//returns the chain configuration and enabled flag, read at most once per action
+const wraplock::global& wraplock::get_global(){
+
+    check_initialized();
+
+    return *_cached_global;
+
+}
+
+//sets the enabled flag, written back by `flush_state`
+void wraplock::set_enabled(const bool enabled){
+
+    check_initialized();
+
+    _cached_global->enabled = enabled;
+    _global_modified = true;
+
+}
+
+//returns the token registry, read at most once per action (nullptr until `migratemap` has built it)
+const wraplock::token_registry* wraplock::get_registry(){
+
+    if (!_registry_loaded) {
+        if (registry_table().exists()) _cached_registry = registry_table().get();
+        _registry_loaded = true;
+    }
+
+    return _cached_registry ? &*_cached_registry : nullptr;
+
+}
+
+//returns the mapping of a native token contract, read at most once per action
+std::optional<wraplock::contract_mapping> wraplock::find_mapping(const name& native_token_contract){
+
+    if (const auto* registry = get_registry()) {
+        auto itr = std::lower_bound(registry->by_native.begin(), registry->by_native.end(), native_token_contract, []( const auto& m, const name& n ) {
+            return m.native_token_contract < n;
+        });
+        if (itr == registry->by_native.end() || itr->native_token_contract != native_token_contract) return std::nullopt;
+        return *itr;
+    }
+
+    for (const auto& m : _cached_mappings) {
+        if (m.native_token_contract == native_token_contract) return m;
+    }
+
+    auto itr = mapping_table().find( native_token_contract.value );
+    if (itr == mapping_table().end()) return std::nullopt;
+
+    _cached_mappings.push_back(*itr);
+    return *itr;
+
+}
+
+//returns the mapping of a paired wraptoken contract, read at most once per action
+std::optional<wraplock::contract_mapping> wraplock::find_paired_mapping(const name& paired_wraptoken_contract){
+
+    if (const auto* registry = get_registry()) {
+        auto itr = std::lower_bound(registry->by_paired.begin(), registry->by_paired.end(), paired_wraptoken_contract, []( const auto& m, const name& n ) {
+            return m.paired_wraptoken_contract < n;
+        });
+        if (itr == registry->by_paired.end() || itr->paired_wraptoken_contract != paired_wraptoken_contract) return std::nullopt;
+        return *itr;
+    }
+
+    for (const auto& m : _cached_mappings) {
+        if (m.paired_wraptoken_contract == paired_wraptoken_contract) return m;
+    }
+
+    auto contractmap_index = mapping_table().get_index<"wraptoken"_n>();
+    auto itr = contractmap_index.find( paired_wraptoken_contract.value );
+    if (itr == contractmap_index.end()) return std::nullopt;
+
+    _cached_mappings.push_back(*itr);
+    return *itr;
+
+}
+
+//returns the cached reserve balance of a token, reading its row at most once per action
+wraplock::cached_reserve& wraplock::get_reserve(const extended_asset& value){
+
+    for (auto& r : _cached_reserves) {
+        if (r.contract == value.contract && r.balance.symbol.code() == value.quantity.symbol.code()) return r;
+    }
+
+    cached_reserve r = {
+      .contract = value.contract,
+      .balance = asset(0, value.quantity.symbol),
+      .itr = internal_use_do_not_use::db_find_i64(_self.value, value.contract.value, "reserves"_n.value, value.quantity.symbol.code().raw()),
+      .modified = false
+    };
+
+    if (r.itr >= 0) {
+        std::vector<char> data( internal_use_do_not_use::db_get_i64(r.itr, nullptr, 0) );
+        internal_use_do_not_use::db_get_i64(r.itr, data.data(), data.size());
+        r.balance = unpack<account>(data).balance;
+    }
+
+    _cached_reserves.push_back(r);
+    return _cached_reserves.back();
+
+}
+
+//writes the rows modified through the state cache back to the database, once per action
+void wraplock::flush_state(){
+
+    if (_global_modified) {
+#ifdef WRAPLOCK_STATIC_CONFIG
+        _status.set(wraplock::status{ .enabled = _cached_global->enabled }, _self);
+#else
+        global_config.set(*_cached_global, _self);
+#endif
+        _global_modified = false;
+    }
+
+    for (auto& r : _cached_reserves) {
+        if (!r.modified) continue;
+
+        auto data = pack( account{ r.balance } );
+        if (r.itr >= 0) {
+            internal_use_do_not_use::db_update_i64(r.itr, _self.value, data.data(), data.size());
+        } else {
+            r.itr = internal_use_do_not_use::db_store_i64(r.contract.value, "reserves"_n.value, _self.value, r.balance.symbol.code().raw(), data.data(), data.size());
+        }
+        r.modified = false;
+    }
+
+}
+
+//selects the paired chain the current action operates on and opens its tables (`_self` is the default chain)
+const wraplock::chain_route& wraplock::select_chain(const name& chain){
+
+    if (_route) {
+        check(_route->scope == chain, "action spans several paired chains");
+        return *_route;
+    }
+
+    if (chain == _self) {
+        const auto& global = get_global();
+        _route = chain_route{ .scope = _self, .bridge_contract = global.bridge_contract, .paired_chain_id = global.paired_chain_id };
+    } else {
+        const auto& c = _pairedchainstable.get( chain.value, "paired chain not found" );
+        _route = chain_route{ .scope = c.chain, .bridge_contract = c.bridge_contract, .paired_chain_id = c.paired_chain_id };
+    }
+
+    _replaytable.emplace(_self, chain.value);
+    _replaystate.emplace(_self, chain.value);
+    _contractmappingtable.emplace(_self, chain.value);
+    _registry.emplace(_self, chain.value);
+
+    return *_route;
+
+}
+
+//selects the paired chain a block proof was produced on
+const wraplock::chain_route& wraplock::select_proof_chain(const checksum256& paired_chain_id){
+
+    if (paired_chain_id == get_global().paired_chain_id) return select_chain(_self);
+
+    auto chainid_index = _pairedchainstable.get_index<"chainid"_n>();
+    auto itr = chainid_index.find( paired_chain_id );
+    check(itr != chainid_index.end(), "proof chain does not match paired chain");
+
+    return select_chain(itr->chain);
+
+}
+
+//returns the paired chain of the current action, the default chain unless another one was selected
+const wraplock::chain_route& wraplock::route(){
+
+    return _route ? *_route : select_chain(_self);
+
+}
+
+wraplock::replaytable& wraplock::replay_table(){
+    route();
+    return *_replaytable;
+}
+
+wraplock::replaystatetable& wraplock::replay_state_table(){
+    route();
+    return *_replaystate;
+}
+
+wraplock::contractmapping& wraplock::mapping_table(){
+    route();
+    return *_contractmappingtable;
+}
+
+wraplock::registrytable& wraplock::registry_table(){
+    route();
+    return *_registry;
+}
+
+void wraplock::addchain(const name& chain, const checksum256& paired_chain_id, const name& bridge_contract)
+{
+    check_initialized();
+
+    require_auth( _self );
+
+    check( chain != name() && chain != _self, "invalid chain name" );
+
+    check( is_account( bridge_contract ), "bridge_contract account does not exist" );
+
+    check( paired_chain_id != get_global().paired_chain_id, "chain already paired" );
+
+    auto chainid_index = _pairedchainstable.get_index<"chainid"_n>();
+    check( chainid_index.find( paired_chain_id ) == chainid_index.end(), "chain already paired" );
+
+    check( _pairedchainstable.find( chain.value ) == _pairedchainstable.end(), "chain name already in use" );
+
+    _pairedchainstable.emplace( _self, [&]( auto& c ){
+        c.chain = chain;
+        c.paired_chain_id = paired_chain_id;
+        c.bridge_contract = bridge_contract;
+    });
+}
+
+void wraplock::delchain(const name& chain)
+{
+    check_initialized();
+
+    require_auth( _self );
+
+    auto itr = _pairedchainstable.find( chain.value );
+    check( itr != _pairedchainstable.end(), "paired chain not found" );
+
+    select_chain(chain);
+    check( mapping_table().begin() == mapping_table().end(), "paired chain still has registered contracts" );
+
+    if (registry_table().exists()) registry_table().remove();
+
+    _pairedchainstable.erase(itr);
+}
+
+void wraplock::addcontract(const name& native_token_contract, const name& paired_wraptoken_contract, const binary_extension<name>& chain)
+{
+    check_initialized();
+
+    require_auth( _self );
+
+    select_chain( chain.has_value() ? chain.value() : _self );
+
+    check( is_account( native_token_contract ), "native_token_contract account does not exist" );
+
+    check( !find_mapping( native_token_contract ), "contract already registered");
+
+    mapping_table().emplace( _self, [&]( auto& c ){
+        c.native_token_contract = native_token_contract;
+        c.paired_wraptoken_contract = paired_wraptoken_contract;
+    });
+
+    if (get_registry()) {
+        auto& registry = *_cached_registry;
+        contract_mapping m = { .native_token_contract = native_token_contract, .paired_wraptoken_contract = paired_wraptoken_contract };
+
+        registry.by_native.insert(std::upper_bound(registry.by_native.begin(), registry.by_native.end(), m, []( const auto& a, const auto& b ) {
+            return a.native_token_contract < b.native_token_contract;
+        }), m);
+        registry.by_paired.insert(std::upper_bound(registry.by_paired.begin(), registry.by_paired.end(), m, []( const auto& a, const auto& b ) {
+            return a.paired_wraptoken_contract < b.paired_wraptoken_contract;
+        }), m);
+
+        registry_table().set(registry, _self);
+    }
+}
+
+void wraplock::delcontract(const name& native_token_contract, const binary_extension<name>& chain)
+{
+    check_initialized();
+
+    require_auth( _self );
+
+    select_chain( chain.has_value() ? chain.value() : _self );
+
+    check( is_account( native_token_contract ), "native_token_contract account does not exist" );
+
+    auto itr = mapping_table().find( native_token_contract.value );
+    check( itr != mapping_table().end(), "contract not registered");
+
+    mapping_table().erase(itr);
+
+    if (get_registry()) {
+        auto& registry = *_cached_registry;
+        auto is_removed = [&]( const auto& m ) { return m.native_token_contract == native_token_contract; };
+
+        registry.by_native.erase(std::remove_if(registry.by_native.begin(), registry.by_native.end(), is_removed), registry.by_native.end());
+        registry.by_paired.erase(std::remove_if(registry.by_paired.begin(), registry.by_paired.end(), is_removed), registry.by_paired.end());
+
+        registry_table().set(registry, _self);
+    }
+}
+
+//Build the token registry from the contractmap table.
+void wraplock::migratemap(const binary_extension<name>& chain)
+{
+    require_auth( _self );
+
+    select_chain( chain.has_value() ? chain.value() : _self );
+
+    check( !registry_table().exists(), "token registry already built" );
+
+    token_registry registry;
+
+    // contractmap rows are ordered by native token contract
+    for (const auto& c : mapping_table()) registry.by_native.push_back(c);
+
+    registry.by_paired = registry.by_native;
+    std::stable_sort(registry.by_paired.begin(), registry.by_paired.end(), []( const auto& a, const auto& b ) {
+        return a.paired_wraptoken_contract < b.paired_wraptoken_contract;
+    });
+
+    registry_table().set(registry, _self);
+}
+
+//returns the bridge handoff table and check action used for a block proof type
+static std::pair<name, name> proof_handoff(const bridge::heavyproof&){
+    return { "heavyproof"_n, wraplock::heavyproof_action::action_name };
+}
+
+static std::pair<name, name> proof_handoff(const bridge::lightproof&){
+    return { "lightproof"_n, wraplock::lightproof_action::action_name };
+}
+
+//locates the proofs of a withdraw/cancel action taking a single action proof within its action data
+template<typename T>
+wraplock::proof_view wraplock::view_proofs(const T& blockproof, const bridge::actionproof& actionproof){
+
+    proof_view view;
+    view.data.resize(action_data_size());
+    read_action_data(view.data.data(), view.data.size());
+
+    std::tie(view.handoff_table, view.check_name) = proof_handoff(blockproof);
+
+    view.blockproof_end = sizeof(name) + pack_size(blockproof);
+    view.actionproofs.emplace_back(view.blockproof_end, pack_size(actionproof));
+
+    check(view.blockproof_end + view.actionproofs[0].second == view.data.size(), "unexpected proof layout");
+
+    return view;
+
+}
+
+//locates the proofs of a batch withdraw/cancel action within its action data
+template<typename T>
+wraplock::proof_view wraplock::view_proofs(const T& blockproof, const std::vector<bridge::actionproof>& actionproofs){
+
+    proof_view view;
+    view.data.resize(action_data_size());
+    read_action_data(view.data.data(), view.data.size());
+
+    std::tie(view.handoff_table, view.check_name) = proof_handoff(blockproof);
+
+    view.blockproof_end = sizeof(name) + pack_size(blockproof);
+    view.actionproofs.reserve(actionproofs.size());
+
+    size_t offset = view.blockproof_end + pack_size(unsigned_int(actionproofs.size()));
+    for (const auto& actionproof : actionproofs) {
+        size_t size = pack_size(actionproof);
+        view.actionproofs.emplace_back(offset, size);
+        offset += size;
+    }
+
+    check(offset == view.data.size(), "unexpected proof layout");
+
+    return view;
+
+}
+
+//hands a block proof to the bridge for the checks queued by check_action (passed with each check in inline mode)
+//a proof singleton row is serialized as its 8-byte id followed by the proof, which is exactly the `prover` name and
+//block proof at the start of the action data, so that range is stored as is (with the prover as id)
+void wraplock::store_proof([[maybe_unused]] const proof_view& view){
+#ifndef WRAPLOCK_INLINE_PROOFS
+    WRAPLOCK_TRACE_DETAIL("proof", "storing ", uint64_t(view.blockproof_end), " bytes in ", view.handoff_table);
+
+    const uint64_t table = view.handoff_table.value;
+    auto itr = internal_use_do_not_use::db_find_i64(_self.value, _self.value, table, table);
+    if (itr >= 0) internal_use_do_not_use::db_update_i64(itr, _self.value, view.data.data(), view.blockproof_end);
+    else internal_use_do_not_use::db_store_i64(_self.value, table, _self.value, table, view.data.data(), view.blockproof_end);
+#endif
+}
+
+//queues the bridge verification of an action against the block proof (will fail tx if prove is invalid)
+void wraplock::check_action(const name& bridge_contract, const proof_view& view, const size_t index){
+
+    const auto& [offset, size] = view.actionproofs[index];
+
+    action act;
+    act.account = bridge_contract;
+    act.name = view.check_name;
+    act.authorization.emplace_back(_self, "active"_n);
+
+#ifdef WRAPLOCK_INLINE_PROOFS
+    //(blockproof, actionproof)
+    act.data.reserve(view.blockproof_end - sizeof(name) + size);
+    act.data.insert(act.data.end(), view.data.begin() + sizeof(name), view.data.begin() + view.blockproof_end);
+#else
+    //(contract, actionproof)
+    act.data.reserve(sizeof(name) + size);
+    act.data.insert(act.data.end(), (const char*)&_self.value, (const char*)&_self.value + sizeof(name));
+#endif
+    act.data.insert(act.data.end(), view.data.begin() + offset, view.data.begin() + offset + size);
+
+    WRAPLOCK_TRACE("proof", "queued ", bridge_contract, "::", view.check_name, " for action proof ", uint64_t(index));
+
+    act.send();
+
+}
+
+//queues removal of the stored block proof after the bridge checks, so it doesn't outlive the transaction
+void wraplock::release_proof(){
+#ifndef WRAPLOCK_INLINE_PROOFS
+    wraplock::clearproof_action act(_self, permission_level{_self, "active"_n});
+    act.send();
+#endif
+}
+
+//Remove block proofs handed to the bridge.
+void wraplock::clearproof(){
+
+    require_auth(_self);
+
+    //the rows are removed by key like `store_proof` writes them, without unpacking the proofs
+    for (const name table : { "lightproof"_n, "heavyproof"_n }) {
+        auto itr = internal_use_do_not_use::db_find_i64(_self.value, _self.value, table.value, table.value);
+        if (itr >= 0) internal_use_do_not_use::db_remove_i64(itr);
+    }
+
+}
+
+//emits an xfer receipt to serve as proof in interchain transfers
+void wraplock::emitxfer(const wraplock::xfer& /*xfer*/){
+
+    check_initialized();
+ 
+    require_auth(_self);
+
+}
+
+//emits several xfer receipts at once, to serve as a single proof in interchain transfers
+void wraplock::emitxfers(const std::vector<wraplock::xfer>& /*xfers*/){
+
+    check_initialized();
+ 
+    require_auth(_self);
+
+}
+
+//emits an xfer receipt in the compact encoding
+void wraplock::emitpacked(const std::vector<char>& /*data*/){
+
+    check_initialized();
+ 
+    require_auth(_self);
+
+}
+
+//emits an xfer receipt for a paired chain added by `addchain`
+void wraplock::emitxferto(const checksum256& /*paired_chain_id*/, const wraplock::xfer& /*xfer*/){
+
+    check_initialized();
+ 
+    require_auth(_self);
+
+}
+
+//emits several xfer receipts at once for a paired chain added by `addchain`
+void wraplock::emitxfersto(const checksum256& /*paired_chain_id*/, const std::vector<wraplock::xfer>& /*xfers*/){
+
+    check_initialized();
+ 
+    require_auth(_self);
+
+}
+
+//Disable all user actions on the contract.
+void wraplock::disable(){
+
+    check_initialized();
+ 
+    require_auth(_self);
+
+    set_enabled(false);
+
+}
+
+//Enable all user actions on the contract.
+void wraplock::enable(){
+
+    check_initialized();
+ 
+    require_auth(_self);
+
+    set_enabled(true);
+
+}
+
+//Advance the replay watermark and delete replay records older than it.
+void wraplock::prune(const uint32_t max_rows, const binary_extension<name>& chain, const binary_extension<uint32_t>& retention){
+
+    require_auth(_self);
+
+    select_chain( chain.has_value() ? chain.value() : _self );
+
+    check(max_rows > 0, "max_rows must be positive");
+
+    //legacy digest rows were all written before the first prune, so they only cover proofs older than this
+    replay_state defaultstate = { .watermark = block_timestamp(), .legacy_cutoff = current_time_point() };
+    auto state = replay_state_table().get_or_create(_self, defaultstate);
+
+    if (retention.has_value()) {
+        //proofs must remain usable past the cancel delay
+        check(retention.value() > 900, "retention must exceed the 15 minute cancel delay");
+        state.retention.emplace(retention.value());
+    }
+
+    check(state.retention.has_value(), "retention must be set by the first prune");
+
+    block_timestamp watermark( current_time_point() - seconds(state.retention.value()) );
+    if (watermark.slot > state.watermark.slot) state.watermark = watermark;
+
+    uint32_t rows = 0;
+
+    //pages follow the paired chain sequence, stop at the first one still holding a proof newer than the watermark
+    auto page = replay_table().begin();
+    while (rows < max_rows && page != replay_table().end() && page->latest.slot < state.watermark.slot) {
+        page = replay_table().erase(page);
+        rows++;
+    }
+
+    //the legacy digest table only holds proofs of the default chain
+    if (route().scope == _self && state.watermark.to_time_point() > state.legacy_cutoff) {
+
+        auto processed = _processedtable.begin();
+        while (rows < max_rows && processed != _processedtable.end()) {
+            processed = _processedtable.erase(processed);
+            rows++;
+        }
+
+    }
+
+    replay_state_table().set(state, _self);
+
+}
+
+//Number a token for compact receipts.
+void wraplock::addtoken(const extended_symbol& token){
+
+    check_initialized();
+
+    require_auth( _self );
+
+    check( token.get_symbol().is_valid(), "invalid symbol name" );
+    check( find_mapping( token.get_contract() ).has_value(), "contract not registered" );
+    check( get_registry() != nullptr, "token registry must be built first" );
+    check( !find_token_id( token ), "token already numbered" );
+
+    auto& registry = *_cached_registry;
+    if (!registry.tokens.has_value()) registry.tokens.emplace();
+    registry.tokens.value().push_back(token);
+
+    registry_table().set(registry, _self);
+
+}
+
+//Report which action receipts would be rejected as replays.
+wraplock::processed_info wraplock::isprocessed(const std::vector<wraplock::receipt_query>& receipts, const binary_extension<name>& chain){
+
+    check(receipts.size() <= MAX_PROCESSED_QUERY, "too many receipts, at most 1984 per call");
+
+    select_chain( chain.has_value() ? chain.value() : _self );
+
+    wraplock::processed_info info = {
+      .watermark = replay_state_table().get_or_default().watermark
+    };
+    info.rejected.resize((receipts.size() + 7) / 8);
+
+    for (size_t i = 0; i < receipts.size(); i++) {
+        //records older than the watermark may have been pruned, `add_or_assert` rejects their proofs either way
+        bool rejected = receipts[i].block_time.slot < info.watermark.slot || is_processed(receipts[i].receipt);
+        if (rejected) info.rejected[i / 8] |= uint8_t(1) << (i % 8);
+    }
+
+    return info;
+
+}
+
+//Report the locked balance of tokens.
+std::vector<int64_t> wraplock::getreserves(const std::vector<extended_symbol>& tokens){
+
+    check(tokens.size() <= MAX_RESERVES_QUERY, "too many tokens, at most 31 per call");
+
+    std::vector<int64_t> balances;
+    balances.reserve(tokens.size());
+
+    for (const auto& token : tokens) balances.push_back( get_reserve( extended_asset(0, token) ).balance.amount );
+
+    return balances;
+
+}
+
+//Report the chain configuration.
+wraplock::config_info wraplock::getconfig(const name& first_chain){
+
+    wraplock::config_info info = {
+      .global = get_global(),
+      .payout_queue = _payoutqueue.get_or_default().enabled
+    };
+
+    auto itr = _pairedchainstable.lower_bound( first_chain.value );
+    for (; itr != _pairedchainstable.end() && info.chains.size() < MAX_CONFIG_CHAINS; itr++) info.chains.push_back(*itr);
+    if (itr != _pairedchainstable.end()) info.next_chain = itr->chain;
+
+    return info;
+
+}
+
+void wraplock::sub_reserve( const extended_asset& value ){
+
+   auto& res = get_reserve( value );
+   check( res.itr >= 0, "no balance object found" );
+   check( res.balance.amount >= value.quantity.amount, "overdrawn balance" );
+
+   res.balance -= value.quantity;
+   res.modified = true;
+}
+
+void wraplock::add_reserve(const extended_asset& value){
+
+   auto& res = get_reserve( value );
+
+   res.balance += value.quantity;
+   res.modified = true;
+
+}
+
+// called on transfer action to lock tokens and initiate interchain transfer
+void wraplock::deposit(name from, name to, asset quantity, string memo)
+{ 
+
+    //ignore outbound transfers from this contract (including withdraw payouts), inbound transfers of tokens internal
+    //to this contract and unstaking transfers, before touching any state
+    if (to != get_self() || from == get_self() || from == "eosio.stake"_n) return;
+
+    check(memo.size() > 0, "memo must contain valid account name");
+
+    check(quantity.amount > 0, "must lock positive quantity");
+
+    WRAPLOCK_TRACE_DETAIL("deposit", "transfer ", from, " ", to, " ", quantity, " sender ", get_sender());
+    
+    const auto& global = get_global();
 
-    auto pid_index = _processedtable.get_index<"digest"_n>();
+    check(global.enabled == true, "contract has been disabled");
 
-    std::vector<char> serializedAction = pack(actionproof.action);
-    std::vector<char> serializedReceipt = pack(actionproof.receipt);
-    checksum256 action_digest = sha256(serializedAction.data(), serializedAction.size());
-    checksum256 action_receipt_digest = sha256(serializedReceipt.data(), serializedReceipt.size());
+    //memo is `beneficiary` for the default chain, or `beneficiary@chain` for a chain added by `addchain`
+    auto separator = memo.find('@');
+    name beneficiary( std::string_view(memo).substr(0, separator) );
+    name chain = separator == string::npos ? _self : name( std::string_view(memo).substr(separator + 1) );
 
-    auto p_itr = pid_index.find(action_receipt_digest);
+    check(beneficiary != name(), "memo must contain valid account name");
 
-    check(p_itr == pid_index.end(), "action already proved");
+    select_chain(chain);
 
-    _processedtable.emplace( payer, [&]( auto& s ) {
-        s.id = _processedtable.available_primary_key();
-        s.receipt_digest = action_receipt_digest;
-    });
+    check(find_mapping( get_sender() ).has_value(), "transfer not permitted from unauthorised token contract");
 
-}
+    //locks the tokens in the reserve and calls emitxfer to be used for issue/cancel proof
+    add_reserve( extended_asset{quantity, get_sender()} );
 
-void wraplock::init(const checksum256& chain_id, const name& bridge_contract, const checksum256& paired_chain_id)
-{
-    check(!global_config.exists(), "contract already initialized");
+    wraplock::xfer x = {
+      .owner = from,
+      .quantity = extended_asset(quantity, get_sender()),
+      .beneficiary = beneficiary
+    };
 
-    require_auth( _self );
+    //deposit batches are emitted as `emitxfers`, so they only collect deposits for the default chain
+    if (chain == _self) {
+      auto batch = _batchestable.find( from.value );
+      if (batch != _batchestable.end()) {
+        check(batch->filled < batch->xfers.size(), "deposit batch is full");
+        _batchestable.modify( batch, same_payer, [&]( auto& b ) {
+          b.xfers[b.filled++] = { .owner = x.owner, .quantity = x.quantity, .beneficiary = x.beneficiary };
+        });
+        WRAPLOCK_TRACE("deposit", "batched ", quantity, " from ", from, " for ", x.beneficiary);
+        set_deposit_result(x);
+        return;
+      }
+    }
 
-    check( is_account( bridge_contract ), "bridge_contract account does not exist" );
+    WRAPLOCK_TRACE("deposit", "locked ", quantity, " from ", from, " for ", x.beneficiary, " on ", chain);
 
-    auto global = global_config.get_or_create(_self, globalrow);
-    global.chain_id = chain_id;
-    global.bridge_contract = bridge_contract;
-    global.paired_chain_id = paired_chain_id;
-    global.enabled = false;
-    global_config.set(global, _self);
+    send_xfer(x);
+
+    set_deposit_result(x);
 
 }
 
-void wraplock::addcontract(const name& native_token_contract, const name& paired_wraptoken_contract)
+//Start collecting deposits of an account into a single receipt.
+void wraplock::openbatch(const name& owner, const uint32_t count)
 {
-    check(global_config.exists(), "contract must be initialized first");
+    require_auth(owner);
 
-    require_auth( _self );
+    check(get_global().enabled == true, "contract has been disabled");
 
-    check( is_account( native_token_contract ), "native_token_contract account does not exist" );
+    check(count > 0 && count <= MAX_BATCH_XFERS, "invalid batch size");
 
-    auto itr = _contractmappingtable.find( native_token_contract.value );
-    check( itr == _contractmappingtable.end(), "contract already registered");
+    check(_batchestable.find( owner.value ) == _batchestable.end(), "deposit batch already open");
 
-    _contractmappingtable.emplace( _self, [&]( auto& c ){
-        c.native_token_contract = native_token_contract;
-        c.paired_wraptoken_contract = paired_wraptoken_contract;
+    _batchestable.emplace( owner, [&]( auto& b ) {
+        b.owner = owner;
+        b.filled = 0;
+        b.xfers.resize(count);
     });
 }
 
-void wraplock::delcontract(const name& native_token_contract)
+//Emit the deposits collected for an account as a single receipt.
+void wraplock::closebatch(const name& owner)
 {
-    check(global_config.exists(), "contract must be initialized first");
+    require_auth(owner);
 
-    require_auth( _self );
+    auto batch = _batchestable.find( owner.value );
+    check(batch != _batchestable.end(), "no deposit batch open");
 
-    check( is_account( native_token_contract ), "native_token_contract account does not exist" );
+    if (batch->filled > 0) {
+        std::vector<wraplock::xfer> xfers;
+        xfers.reserve(batch->filled);
+
+        for (uint32_t i = 0; i < batch->filled; i++) {
+            const auto& slot = batch->xfers[i];
+            xfers.push_back(wraplock::xfer{ .owner = slot.owner, .quantity = slot.quantity, .beneficiary = slot.beneficiary });
+        }
 
-    auto itr = _contractmappingtable.find( native_token_contract.value );
-    check( itr != _contractmappingtable.end(), "contract not registered");
+        send_xfers(xfers);
+    }
 
-    _contractmappingtable.erase(itr);
+    _batchestable.erase(batch);
 }
 
-//emits an xfer receipt to serve as proof in interchain transfers
-void wraplock::emitxfer(const wraplock::xfer& xfer){
+//sends one transfer per beneficiary and token for a set of redeemed xfers
+void wraplock::send_payouts(const std::vector<wraplock::xfer>& redeemed){
 
-    check(global_config.exists(), "contract must be initialized first");
- 
-    require_auth(_self);
+    std::vector<wraplock::xfer> payouts;
+
+    for (const auto& r : redeemed) {
+        auto itr = std::find_if(payouts.begin(), payouts.end(), [&]( const auto& p ) {
+            return p.beneficiary == r.beneficiary && p.quantity.get_extended_symbol() == r.quantity.get_extended_symbol();
+        });
+        if (itr == payouts.end()) payouts.push_back(r);
+        else itr->quantity += r.quantity;
+    }
+
+    for (const auto& p : payouts) {
+        wraplock::transfer_action act(p.quantity.contract, permission_level{_self, "active"_n});
+        act.send(_self, p.beneficiary, p.quantity.quantity, std::string("") );
+    }
 
 }
 
-//Disable all user actions on the contract.
-void wraplock::disable(){
+//reserves `count` consecutive xfer sequence numbers of the paired chain of the current action, returning the first
+uint64_t wraplock::next_sequences(const uint64_t count){
 
-    check(global_config.exists(), "contract must be initialized first");
- 
-    require_auth(_self);
+    xfersequencetable sequence(_self, route().scope.value);
+    auto state = sequence.get_or_default();
 
-    auto global = global_config.get();
-    global.enabled = false;
-    global_config.set(global, _self);
+    uint64_t first = state.next;
+    state.next += count;
+    sequence.set(state, _self);
+
+    return first;
 
 }
 
-//Enable all user actions on the contract.
-void wraplock::enable(){
+//appends an unsigned LEB128 varint
+static void write_varuint(std::vector<char>& data, uint64_t value){
+    do {
+        uint8_t b = value & 0x7f;
+        value >>= 7;
+        data.push_back( value ? (b | 0x80) : b );
+    } while (value);
+}
 
-    check(global_config.exists(), "contract must be initialized first");
- 
-    require_auth(_self);
+//reads an unsigned LEB128 varint
+static uint64_t read_varuint(datastream<const char*>& ds){
+    uint64_t value = 0;
+    uint8_t b = 0;
+    for (uint32_t shift = 0; ; shift += 7) {
+        check(shift < 64 && ds.remaining() > 0, "invalid packed xfer");
+        ds >> b;
+        value |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) return value;
+    }
+}
 
-    auto global = global_config.get();
-    global.enabled = true;
-    global_config.set(global, _self);
+//returns the id of a token numbered by `addtoken`
+std::optional<uint32_t> wraplock::find_token_id(const extended_symbol& token){
+
+    const auto* registry = get_registry();
+    if (!registry || !registry->tokens.has_value()) return std::nullopt;
+
+    const auto& tokens = registry->tokens.value();
+    auto itr = std::find(tokens.begin(), tokens.end(), token);
+    if (itr == tokens.end()) return std::nullopt;
+
+    return uint32_t(itr - tokens.begin());
 
 }
 
-void wraplock::sub_reserve( const extended_asset& value ){
+//encodes an xfer for `emitpacked`, see XFER_PACKED_VERSION
+std::vector<char> wraplock::encode_xfer(const wraplock::xfer& xfer, const uint32_t token_id){
 
-   reserves _reservestable( _self, value.contract.value );
-   const auto& res = _reservestable.get( value.quantity.symbol.code().raw(), "no balance object found" );
-   check( res.balance.amount >= value.quantity.amount, "overdrawn balance" );
+    std::vector<char> data;
+    data.reserve(1 + 2 * sizeof(uint64_t) + 3 * 10);
+
+    data.push_back(XFER_PACKED_VERSION);
+
+    for (const name& n : { xfer.owner, xfer.beneficiary }) {
+        const char* bytes = reinterpret_cast<const char*>(&n.value);
+        data.insert(data.end(), bytes, bytes + sizeof(uint64_t));
+    }
+
+    write_varuint(data, token_id);
+    write_varuint(data, xfer.quantity.quantity.amount);
+    write_varuint(data, xfer.sequence.value());
+
+    return data;
 
-   _reservestable.modify( res, _self, [&]( auto& a ) {
-         a.balance -= value.quantity;
-      });
 }
 
-void wraplock::add_reserve(const extended_asset& value){
+//decodes the xfer of a proven `emitxfer` or `emitpacked` action
+wraplock::xfer wraplock::decode_xfer(const bridge::action& act){
+
+    if (act.name == "emitxfer"_n) return unpack<wraplock::xfer>(act.data);
+
+    //packed receipts only name tokens of the default chain registry
+    check(route().scope == _self, "packed xfer not supported for this chain");
+
+    auto data = unpack<std::vector<char>>(act.data);
+    datastream<const char*> ds(data.data(), data.size());
+
+    uint8_t version = 0;
+    check(ds.remaining() >= 1 + 2 * sizeof(uint64_t), "invalid packed xfer");
+    ds >> version;
+    check(version == XFER_PACKED_VERSION, "unsupported packed xfer version");
+
+    wraplock::xfer xfer;
+    ds >> xfer.owner;
+    ds >> xfer.beneficiary;
 
-   reserves _reservestable( _self, value.contract.value );
-   auto res = _reservestable.find(  value.quantity.symbol.code().raw() );
-   if( res == _reservestable.end() ) {
-      _reservestable.emplace( _self, [&]( auto& a ){
-        a.balance = value.quantity;
-      });
-   } else {
-      _reservestable.modify( res, _self, [&]( auto& a ) {
-        a.balance += value.quantity;
-      });
-   }
+    uint64_t token_id = read_varuint(ds);
+    uint64_t amount = read_varuint(ds);
+    xfer.sequence.emplace( read_varuint(ds) );
+
+    const auto* registry = get_registry();
+    check(registry && registry->tokens.has_value() && token_id < registry->tokens.value().size(), "unknown token id");
+    check(amount <= uint64_t(asset::max_amount), "invalid packed xfer amount");
+
+    const auto& token = registry->tokens.value()[token_id];
+    xfer.quantity = extended_asset( asset(int64_t(amount), token.get_symbol()), token.get_contract() );
+
+    return xfer;
 
 }
 
-// called on transfer action to lock tokens and initiate interchain transfer
-void wraplock::deposit(name from, name to, asset quantity, string memo)
-{ 
+//emits the receipt of a transfer for the paired chain of the current action
+void wraplock::send_xfer(wraplock::xfer& xfer){
+
+    xfer.sequence.emplace( next_sequences(1) );
+
+    if (route().scope == _self) {
+        auto token_id = find_token_id( xfer.quantity.get_extended_symbol() );
+        if (token_id) {
+            wraplock::emitpacked_action act(_self, permission_level{_self, "active"_n});
+            act.send( encode_xfer(xfer, *token_id) );
+            return;
+        }
+        wraplock::emitxfer_action act(_self, permission_level{_self, "active"_n});
+        act.send(xfer);
+    } else {
+        wraplock::emitxferto_action act(_self, permission_level{_self, "active"_n});
+        act.send(route().paired_chain_id, xfer);
+    }
 
-    print("transfer ", name{from}, " ",  name{to}, " ", quantity, "\n");
-    print("sender: ", get_sender(), "\n");
-    
-    check(global_config.exists(), "contract must be initialized first");
-    auto global = global_config.get();
+}
 
-    check(global.enabled == true, "contract has been disabled");
+//emits a single receipt of several transfers for the paired chain of the current action
+void wraplock::send_xfers(std::vector<wraplock::xfer>& xfers){
+
+    uint64_t first = next_sequences(xfers.size());
+    for (size_t i = 0; i < xfers.size(); i++) xfers[i].sequence.emplace(first + i);
+
+    if (route().scope == _self) {
+        wraplock::emitxfers_action act(_self, permission_level{_self, "active"_n});
+        act.send(xfers);
+    } else {
+        wraplock::emitxfersto_action act(_self, permission_level{_self, "active"_n});
+        act.send(route().paired_chain_id, xfers);
+    }
+
+}
+
+//pays out redeemed xfers, or queues them for `crank` (prover paying for the rows) while the payout queue is enabled
+void wraplock::pay_or_queue(const name& prover, const std::vector<wraplock::xfer>& redeemed){
+
+    if (!_payoutqueue.get_or_default().enabled) {
+        send_payouts(redeemed);
+        return;
+    }
+
+    for (const auto& r : redeemed) {
+        //a payout to a missing account could never be sent
+        check(is_account(r.beneficiary), "beneficiary account does not exist");
+
+        _payoutstable.emplace( prover, [&]( auto& p ) {
+            p.id = _payoutstable.available_primary_key();
+            p.beneficiary = r.beneficiary;
+            p.quantity = r.quantity;
+            p.owner = r.owner;
+            p.chain = route().scope;
+        });
+    }
+
+    WRAPLOCK_TRACE("payout", "queued ", uint64_t(redeemed.size()), " payouts");
+
+}
 
-    auto contractmap = _contractmappingtable.find( get_sender().value );
-    check(contractmap != _contractmappingtable.end(), "transfer not permitted from unauthorised token contract");
+//Switch withdrawals between immediate and queued payouts.
+void wraplock::setqueue(const bool enabled){
 
-    //if incoming transfer
-    if (from == "eosio.stake"_n) return ; //ignore unstaking transfers
-    else if (to == get_self() && from != get_self()){
-      //ignore outbound transfers from this contract, as well as inbound transfers of tokens internal to this contract
-      //otherwise, locks the tokens in the reserve and calls emitxfer to be used for issue/cancel proof
+    check_initialized();
 
-      check(memo.size() > 0, "memo must contain valid account name");
+    require_auth(_self);
+
+    _payoutqueue.set(payout_queue{ .enabled = enabled }, _self);
+
+}
+
+//Pay out queued withdrawals.
+void wraplock::crank(const uint32_t max_payouts, const binary_extension<uint64_t>& first_id){
+
+    check(max_payouts > 0, "max_payouts must be positive");
+
+    check(get_global().enabled == true, "contract has been disabled");
+
+    std::vector<wraplock::xfer> redeemed;
+
+    auto itr = _payoutstable.lower_bound( first_id.has_value() ? first_id.value() : 0 );
+    check(itr != _payoutstable.end(), "no queued payouts");
+
+    for (uint32_t i = 0; i < max_payouts && itr != _payoutstable.end(); i++) {
+        redeemed.push_back(wraplock::xfer{ .owner = _self, .quantity = itr->quantity, .beneficiary = itr->beneficiary });
+        itr = _payoutstable.erase(itr);
+    }
+
+    WRAPLOCK_TRACE("payout", "cranked ", uint64_t(redeemed.size()), " payouts");
+
+    send_payouts(redeemed);
+
+}
+
+//Return a queued payout to the paired chain.
+void wraplock::refundpayout(const uint64_t id){
 
-      check(quantity.amount > 0, "must lock positive quantity");
+    check_initialized();
 
-      add_reserve( extended_asset{quantity, get_sender()} );
+    require_auth(_self);
+
+    const auto& p = _payoutstable.get( id, "payout not found" );
+
+    select_chain(p.chain);
+
+    add_reserve(p.quantity);
+
+    wraplock::xfer x = {
+      .owner = _self,
+      .quantity = p.quantity,
+      .beneficiary = p.owner
+    };
+
+    WRAPLOCK_TRACE("payout", "refunded ", p.quantity.quantity, " to ", p.owner, " on ", p.chain);
 
-      wraplock::xfer x = {
-        .owner = from,
-        .quantity = extended_asset(quantity, get_sender()),
-        .beneficiary = name(memo)
-      };
+    _payoutstable.erase(p);
 
-      wraplock::emitxfer_action act(_self, permission_level{_self, "active"_n});
-      act.send(x);
+    send_xfer(x);
 
+}
+
+//appends a transfer to an action result, along with the reserve left of its token
+void wraplock::add_result(wraplock::action_result& result, const uint64_t sequence, const wraplock::xfer& xfer){
+
+    auto token = std::find_if(result.reserves.begin(), result.reserves.end(), [&]( const auto& r ) {
+        return r.get_extended_symbol() == xfer.quantity.get_extended_symbol();
+    });
+    if (token == result.reserves.end()) {
+        result.reserves.push_back( extended_asset(0, xfer.quantity.get_extended_symbol()) );
+        result.totals.push_back(0);
+        token = result.reserves.end() - 1;
     }
 
+    size_t index = token - result.reserves.begin();
+    token->quantity = get_reserve( xfer.quantity ).balance;
+    result.totals[index] += xfer.quantity.quantity.amount;
+
+    result.transfers.push_back(wraplock::transfer_result{
+      .sequence = sequence,
+      .amount = xfer.quantity.quantity.amount,
+      .token = uint8_t(index)
+    });
+    result.count++;
+
+}
+
+//drops the parts of a batch action result that don't fit in an action return value, in order: the transfer list,
+//the reserves left, then the totals, so that only `count` is always returned
+//(a single transfer always fits)
+void wraplock::fit_result(wraplock::action_result& result){
+
+    if (pack_size(result) <= MAX_RETURN_VALUE_SIZE) return;
+    result.transfers.clear();
+
+    if (pack_size(result) <= MAX_RETURN_VALUE_SIZE) return;
+    result.reserves.clear();
+
+    if (pack_size(result) <= MAX_RETURN_VALUE_SIZE) return;
+    result.totals.clear();
+
+}
+
+//sets the return value of the deposit notification, which the dispatcher does not do for notification handlers
+void wraplock::set_deposit_result(const wraplock::xfer& xfer){
+
+    wraplock::action_result result = { .version = ACTION_RESULT_VERSION };
+    add_result(result, xfer.sequence.has_value() ? xfer.sequence.value() : 0, xfer);
+
+    auto data = pack(result);
+    internal_use_do_not_use::set_action_return_value(data.data(), data.size());
+
+}
+
+// proofs go through the same stages in every withdraw and cancel action, so that doomed transactions fail before
+// paying for the expensive ones. Batch actions run each stage over all their action proofs before the next one:
+//   1. stateless checks (authorization, action name, cancel delay)
+//   2. cheap table reads (global config, paired chain, action payload, contract mapping)
+//   3. replay protection and reserve balance
+//   4. proof handoff and bridge verification
+//   5. payout (or payout queue entry, see `crank`) or receipt
+
+//checks that an action proof is of an xfer receipt
+static void check_xfer_action(const bridge::actionproof& actionproof, const char* message){
+    check(actionproof.action.name == "emitxfer"_n || actionproof.action.name == "emitpacked"_n, message);
 }
 
-void wraplock::_withdraw(const name& prover, const bridge::actionproof actionproof){
-    auto global = global_config.get();
+//decodes the xfer of an action proof, checking that it was emitted by a paired wraptoken contract
+wraplock::xfer wraplock::read_xfer(const bridge::actionproof& actionproof){
+
+    wraplock::xfer x = decode_xfer(actionproof.action);
+
+    check( x.quantity.quantity.symbol.is_valid(), "invalid symbol name" );
+
+    check(find_paired_mapping( actionproof.action.account ).has_value(), "proof account does not match paired account");
+
+    return x;
 
-    auto contractmap_index = _contractmappingtable.get_index<"wraptoken"_n>();
-    auto contractmap = contractmap_index.find( actionproof.action.account.value );
-    check(contractmap != contractmap_index.end(), "proof account does not match paired account");
+}
 
-    wraplock::xfer redeem_act = unpack<wraplock::xfer>(actionproof.action.data);
+//records a retirement as proven and releases its tokens from the reserve
+void wraplock::_withdraw(const name& prover, const block_timestamp& block_time, const bridge::actionproof& actionproof, const wraplock::xfer& redeemed){
 
-    add_or_assert(actionproof, prover);
+    WRAPLOCK_TRACE_DETAIL("withdraw", "global sequence ", actionproof.receipt.global_sequence, " prover ", prover);
 
-    check(actionproof.action.name == "emitxfer"_n, "must provide proof of token retiring before withdrawing");
+    add_or_assert(actionproof, block_time, prover);
 
-    sub_reserve( extended_asset{redeem_act.quantity.quantity, redeem_act.quantity.contract} );
+    sub_reserve( extended_asset{redeemed.quantity.quantity, redeemed.quantity.contract} );
 
-    wraplock::transfer_action act(redeem_act.quantity.contract, permission_level{_self, "active"_n});
-    act.send(_self, redeem_act.beneficiary, redeem_act.quantity.quantity, std::string("") );
+    WRAPLOCK_TRACE("withdraw", "redeemed ", redeemed.quantity.quantity, " for ", redeemed.beneficiary);
 
 }
 
 // withdraw tokens (requires a heavy proof of retiring)
-void wraplock::withdrawa(const name& prover, const bridge::heavyproof blockproof, const bridge::actionproof actionproof){
+wraplock::action_result wraplock::withdrawa(const name& prover, const bridge::heavyproof& blockproof, const bridge::actionproof& actionproof){
     require_auth(prover);
 
-    check(global_config.exists(), "contract must be initialized first");
-    auto global = global_config.get();
+    check_xfer_action(actionproof, "must provide proof of token retiring before withdrawing");
+
+    const auto& global = get_global();
 
     check(global.enabled == true, "contract has been disabled");
 
-    check(blockproof.chain_id == global.paired_chain_id, "proof chain does not match paired chain");
+    const auto& chain = select_proof_chain(blockproof.chain_id);
+
+    wraplock::xfer redeemed = read_xfer(actionproof);
+
+    _withdraw(prover, blockproof.blocktoprove.block.header.timestamp, actionproof, redeemed);
 
     // check proof against bridge
     // will fail tx if prove is invalid
-    auto p = _heavy_proof.get_or_create(_self, _heavy_proof_obj);
-    p.hp = blockproof;
-    _heavy_proof.set(p, _self);
-    wraplock::heavyproof_action checkproof_act(global.bridge_contract, permission_level{_self, "active"_n});
-    checkproof_act.send(_self, actionproof);
+    proof_view view = view_proofs(blockproof, actionproof);
+    store_proof(view);
+    check_action(chain.bridge_contract, view, 0);
+    release_proof();
+
+    pay_or_queue(prover, { redeemed });
 
-    _withdraw(prover, actionproof);
+    wraplock::action_result result = { .version = ACTION_RESULT_VERSION };
+    add_result(result, actionproof.receipt.global_sequence, redeemed);
+    return result;
 }
 
 // withdraw tokens (requires a light proof of retiring)
-void wraplock::withdrawb(const name& prover, const bridge::lightproof blockproof, const bridge::actionproof actionproof){
+wraplock::action_result wraplock::withdrawb(const name& prover, const bridge::lightproof& blockproof, const bridge::actionproof& actionproof){
     require_auth(prover);
 
-    check(global_config.exists(), "contract must be initialized first");
-    auto global = global_config.get();
+    check_xfer_action(actionproof, "must provide proof of token retiring before withdrawing");
+
+    const auto& global = get_global();
 
     check(global.enabled == true, "contract has been disabled");
 
-    check(blockproof.chain_id == global.paired_chain_id, "proof chain does not match paired chain");
+    const auto& chain = select_proof_chain(blockproof.chain_id);
+
+    wraplock::xfer redeemed = read_xfer(actionproof);
+
+    _withdraw(prover, blockproof.header.timestamp, actionproof, redeemed);
 
     // check proof against bridge
     // will fail tx if prove is invalid
-    auto p = _light_proof.get_or_create(_self, _light_proof_obj);
-    p.lp = blockproof;
-    _light_proof.set(p, _self);
-    wraplock::lightproof_action checkproof_act(global.bridge_contract, permission_level{_self, "active"_n});
-    checkproof_act.send(_self, actionproof);
+    proof_view view = view_proofs(blockproof, actionproof);
+    store_proof(view);
+    check_action(chain.bridge_contract, view, 0);
+    release_proof();
 
-    _withdraw(prover, actionproof);
+    pay_or_queue(prover, { redeemed });
+
+    wraplock::action_result result = { .version = ACTION_RESULT_VERSION };
+    add_result(result, actionproof.receipt.global_sequence, redeemed);
+    return result;
 }
 
-void wraplock::_cancel(const name& prover, const bridge::actionproof actionproof)
-{
-    auto global = global_config.get();
+// withdraw tokens for several retirements in the same block (requires a heavy proof of the block)
+wraplock::action_result wraplock::withdrawbata(const name& prover, const bridge::heavyproof& blockproof, const std::vector<bridge::actionproof>& actionproofs){
+    require_auth(prover);
+
+    check(actionproofs.size() > 0, "must provide at least one action proof");
+
+    for (const auto& actionproof : actionproofs) {
+        check_xfer_action(actionproof, "must provide proof of token retiring before withdrawing");
+    }
 
-    auto contractmap_index = _contractmappingtable.get_index<"wraptoken"_n>();
-    auto contractmap = contractmap_index.find( actionproof.action.account.value );
-    check(contractmap != contractmap_index.end(), "proof account does not match paired account");
+    const auto& global = get_global();
 
-    wraplock::xfer redeem_act = unpack<wraplock::xfer>(actionproof.action.data);
+    check(global.enabled == true, "contract has been disabled");
+
+    const auto& chain = select_proof_chain(blockproof.chain_id);
+
+    std::vector<wraplock::xfer> redeemed;
+    redeemed.reserve(actionproofs.size());
+
+    for (const auto& actionproof : actionproofs) redeemed.push_back( read_xfer(actionproof) );
+
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        _withdraw(prover, blockproof.blocktoprove.block.header.timestamp, actionproofs[i], redeemed[i]);
+    }
+
+    // check proofs against bridge, the block proof is stored once for all of them
+    // will fail tx if any prove is invalid
+    proof_view view = view_proofs(blockproof, actionproofs);
+    store_proof(view);
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        check_action(chain.bridge_contract, view, i);
+    }
+    release_proof();
+
+    pay_or_queue(prover, redeemed);
+
+    wraplock::action_result result = { .version = ACTION_RESULT_VERSION };
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        add_result(result, actionproofs[i].receipt.global_sequence, redeemed[i]);
+    }
+    fit_result(result);
+    return result;
+}
+
+// withdraw tokens for several retirements in the same block (requires a light proof of the block)
+wraplock::action_result wraplock::withdrawbatb(const name& prover, const bridge::lightproof& blockproof, const std::vector<bridge::actionproof>& actionproofs){
+    require_auth(prover);
+
+    check(actionproofs.size() > 0, "must provide at least one action proof");
+
+    for (const auto& actionproof : actionproofs) {
+        check_xfer_action(actionproof, "must provide proof of token retiring before withdrawing");
+    }
+
+    const auto& global = get_global();
+
+    check(global.enabled == true, "contract has been disabled");
+
+    const auto& chain = select_proof_chain(blockproof.chain_id);
+
+    std::vector<wraplock::xfer> redeemed;
+    redeemed.reserve(actionproofs.size());
+
+    for (const auto& actionproof : actionproofs) redeemed.push_back( read_xfer(actionproof) );
+
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        _withdraw(prover, blockproof.header.timestamp, actionproofs[i], redeemed[i]);
+    }
+
+    // check proofs against bridge, the block proof is stored once for all of them
+    // will fail tx if any prove is invalid
+    proof_view view = view_proofs(blockproof, actionproofs);
+    store_proof(view);
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        check_action(chain.bridge_contract, view, i);
+    }
+    release_proof();
+
+    pay_or_queue(prover, redeemed);
 
-    add_or_assert(actionproof, prover);
+    wraplock::action_result result = { .version = ACTION_RESULT_VERSION };
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        add_result(result, actionproofs[i].receipt.global_sequence, redeemed[i]);
+    }
+    fit_result(result);
+    return result;
+}
+
+//records a retirement as proven and returns the xfer sending its tokens back to their owner
+wraplock::xfer wraplock::_cancel(const name& prover, const block_timestamp& block_time, const bridge::actionproof& actionproof, const wraplock::xfer& retired)
+{
+    WRAPLOCK_TRACE_DETAIL("cancel", "global sequence ", actionproof.receipt.global_sequence, " prover ", prover);
 
-    auto sym = redeem_act.quantity.quantity.symbol;
-    check( sym.is_valid(), "invalid symbol name" );
+    add_or_assert(actionproof, block_time, prover);
 
-    check(actionproof.action.name == "emitxfer"_n, "must provide proof of token retiring before cancelling");
+    WRAPLOCK_TRACE("cancel", "returned ", retired.quantity.quantity, " to ", retired.owner);
 
+    // return to retired.owner so can be withdrawn from wraplock
     wraplock::xfer x = {
-      .owner = _self, // todo - check whether this should show as redeem_act.beneficiary
-      .quantity = extended_asset(redeem_act.quantity.quantity, redeem_act.quantity.contract),
-      .beneficiary = redeem_act.owner
+      .owner = _self, // todo - check whether this should show as retired.beneficiary
+      .quantity = extended_asset(retired.quantity.quantity, retired.quantity.contract),
+      .beneficiary = retired.owner
     };
 
-    // return to redeem_act.owner so can be withdrawn from wraplock
-    wraplock::emitxfer_action act(_self, permission_level{_self, "active"_n});
-    act.send(x);
+    return x;
 
 }
 
-void wraplock::cancela(const name& prover, const bridge::heavyproof blockproof, const bridge::actionproof actionproof)
+wraplock::action_result wraplock::cancela(const name& prover, const bridge::heavyproof& blockproof, const bridge::actionproof& actionproof)
 {
     require_auth(prover);
 
-    check(global_config.exists(), "contract must be initialized first");
-    auto global = global_config.get();
+    check(current_time_point().sec_since_epoch() > blockproof.blocktoprove.block.header.timestamp.to_time_point().sec_since_epoch() + 900, "must wait 15 minutes to cancel");
+
+    check_xfer_action(actionproof, "must provide proof of token retiring before cancelling");
+
+    const auto& global = get_global();
 
     check(global.enabled == true, "contract has been disabled");
 
-    check(blockproof.chain_id == global.paired_chain_id, "proof chain does not match paired chain");
+    const auto& chain = select_proof_chain(blockproof.chain_id);
 
-    check(current_time_point().sec_since_epoch() > blockproof.blocktoprove.block.header.timestamp.to_time_point().sec_since_epoch() + 900, "must wait 15 minutes to cancel");
+    wraplock::xfer retired = read_xfer(actionproof);
+
+    wraplock::xfer x = _cancel(prover, blockproof.blocktoprove.block.header.timestamp, actionproof, retired);
 
     // check proof against bridge
     // will fail tx if prove is invalid
-    auto p = _heavy_proof.get_or_create(_self, _heavy_proof_obj);
-    p.hp = blockproof;
-    _heavy_proof.set(p, _self);
-    wraplock::heavyproof_action checkproof_act(global.bridge_contract, permission_level{_self, "active"_n});
-    checkproof_act.send(_self, actionproof);
+    proof_view view = view_proofs(blockproof, actionproof);
+    store_proof(view);
+    check_action(chain.bridge_contract, view, 0);
+    release_proof();
 
-    _cancel(prover, actionproof);
+    send_xfer(x);
+
+    wraplock::action_result result = { .version = ACTION_RESULT_VERSION };
+    add_result(result, actionproof.receipt.global_sequence, x);
+    return result;
 }
 
-void wraplock::cancelb(const name& prover, const bridge::lightproof blockproof, const bridge::actionproof actionproof)
+wraplock::action_result wraplock::cancelb(const name& prover, const bridge::lightproof& blockproof, const bridge::actionproof& actionproof)
 {
     require_auth(prover);
 
-    check(global_config.exists(), "contract must be initialized first");
-    auto global = global_config.get();
+    check(current_time_point().sec_since_epoch() > blockproof.header.timestamp.to_time_point().sec_since_epoch() + 900, "must wait 15 minutes to cancel");
+
+    check_xfer_action(actionproof, "must provide proof of token retiring before cancelling");
+
+    const auto& global = get_global();
 
     check(global.enabled == true, "contract has been disabled");
 
-    check(blockproof.chain_id == global.paired_chain_id, "proof chain does not match paired chain");
+    const auto& chain = select_proof_chain(blockproof.chain_id);
 
-    check(current_time_point().sec_since_epoch() > blockproof.header.timestamp.to_time_point().sec_since_epoch() + 900, "must wait 15 minutes to cancel");
+    wraplock::xfer retired = read_xfer(actionproof);
+
+    wraplock::xfer x = _cancel(prover, blockproof.header.timestamp, actionproof, retired);
 
     // check proof against bridge
     // will fail tx if prove is invalid
-    auto p = _light_proof.get_or_create(_self, _light_proof_obj);
-    p.lp = blockproof;
-    _light_proof.set(p, _self);
-    wraplock::lightproof_action checkproof_act(global.bridge_contract, permission_level{_self, "active"_n});
-    checkproof_act.send(_self, actionproof);
+    proof_view view = view_proofs(blockproof, actionproof);
+    store_proof(view);
+    check_action(chain.bridge_contract, view, 0);
+    release_proof();
+
+    send_xfer(x);
+
+    wraplock::action_result result = { .version = ACTION_RESULT_VERSION };
+    add_result(result, actionproof.receipt.global_sequence, x);
+    return result;
+}
+
+wraplock::action_result wraplock::cancelbata(const name& prover, const bridge::heavyproof& blockproof, const std::vector<bridge::actionproof>& actionproofs)
+{
+    require_auth(prover);
+
+    check(actionproofs.size() > 0, "must provide at least one action proof");
+
+    check(current_time_point().sec_since_epoch() > blockproof.blocktoprove.block.header.timestamp.to_time_point().sec_since_epoch() + 900, "must wait 15 minutes to cancel");
+
+    for (const auto& actionproof : actionproofs) {
+        check_xfer_action(actionproof, "must provide proof of token retiring before cancelling");
+    }
+
+    const auto& global = get_global();
+
+    check(global.enabled == true, "contract has been disabled");
+
+    const auto& chain = select_proof_chain(blockproof.chain_id);
+
+    std::vector<wraplock::xfer> retired;
+    retired.reserve(actionproofs.size());
+
+    for (const auto& actionproof : actionproofs) retired.push_back( read_xfer(actionproof) );
+
+    std::vector<wraplock::xfer> xfers;
+    xfers.reserve(actionproofs.size());
+
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        xfers.push_back( _cancel(prover, blockproof.blocktoprove.block.header.timestamp, actionproofs[i], retired[i]) );
+    }
+
+    // check proofs against bridge, the block proof is stored once for all of them
+    // will fail tx if any prove is invalid
+    proof_view view = view_proofs(blockproof, actionproofs);
+    store_proof(view);
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        check_action(chain.bridge_contract, view, i);
+    }
+    release_proof();
+
+    send_xfers(xfers);
+
+    wraplock::action_result result = { .version = ACTION_RESULT_VERSION };
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        add_result(result, actionproofs[i].receipt.global_sequence, xfers[i]);
+    }
+    fit_result(result);
+    return result;
+}
+
+wraplock::action_result wraplock::cancelbatb(const name& prover, const bridge::lightproof& blockproof, const std::vector<bridge::actionproof>& actionproofs)
+{
+    require_auth(prover);
+
+    check(actionproofs.size() > 0, "must provide at least one action proof");
+
+    check(current_time_point().sec_since_epoch() > blockproof.header.timestamp.to_time_point().sec_since_epoch() + 900, "must wait 15 minutes to cancel");
+
+    for (const auto& actionproof : actionproofs) {
+        check_xfer_action(actionproof, "must provide proof of token retiring before cancelling");
+    }
+
+    const auto& global = get_global();
 
-    _cancel(prover, actionproof);
+    check(global.enabled == true, "contract has been disabled");
+
+    const auto& chain = select_proof_chain(blockproof.chain_id);
+
+    std::vector<wraplock::xfer> retired;
+    retired.reserve(actionproofs.size());
+
+    for (const auto& actionproof : actionproofs) retired.push_back( read_xfer(actionproof) );
+
+    std::vector<wraplock::xfer> xfers;
+    xfers.reserve(actionproofs.size());
+
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        xfers.push_back( _cancel(prover, blockproof.header.timestamp, actionproofs[i], retired[i]) );
+    }
+
+    // check proofs against bridge, the block proof is stored once for all of them
+    // will fail tx if any prove is invalid
+    proof_view view = view_proofs(blockproof, actionproofs);
+    store_proof(view);
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        check_action(chain.bridge_contract, view, i);
+    }
+    release_proof();
+
+    send_xfers(xfers);
+
+    wraplock::action_result result = { .version = ACTION_RESULT_VERSION };
+    for (size_t i = 0; i < actionproofs.size(); i++) {
+        add_result(result, actionproofs[i].receipt.global_sequence, xfers[i]);
+    }
+    fit_result(result);
+    return result;
 }
 
 
@@ -321,9 +1548,10 @@ void wraplock::cancelb(const name& prover, const bridge::lightproof blockproof,
   require_auth( _self );
 
   if (global_config.exists()) global_config.remove();
+  if (registry_table().exists()) registry_table().remove();
 
-  auto contractrow = _contractmappingtable.end();
-  while ( _contractmappingtable.begin() != _contractmappingtable.end() ) {
+  auto contractrow = mapping_table().end();
+  while ( mapping_table().begin() != mapping_table().end() ) {
       contractrow--;
       reserves _reservestable( _self, contractrow->native_token_contract.value );
       while (_reservestable.begin() != _reservestable.end()) {
@@ -331,7 +1559,7 @@ void wraplock::cancelb(const name& prover, const bridge::lightproof blockproof,
         itr--;
         _reservestable.erase(itr);
       }
-      _contractmappingtable.erase(contractrow);
+      mapping_table().erase(contractrow);
   }
 
   while (_processedtable.begin() != _processedtable.end()) {
@@ -340,6 +1568,14 @@ void wraplock::cancelb(const name& prover, const bridge::lightproof blockproof,
     _processedtable.erase(itr);
   }
 
+  while (replay_table().begin() != replay_table().end()) {
+    auto itr = replay_table().end();
+    itr--;
+    replay_table().erase(itr);
+  }
+
+  if (replay_state_table().exists()) replay_state_table().remove();
+
   if (_light_proof.exists()) _light_proof.remove();
   if (_heavy_proof.exists()) _heavy_proof.remove();
 